@@ -0,0 +1,502 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "color-generator.hpp"
+#include "detection-pipeline.hpp"
+#include "ethalons.hpp"
+#include "hog.hpp"
+#include "slic.hpp"
+
+// Headless batch processing of a directory of images, a single image or a video file. No windows are opened.
+// Usage: ano-batch <detect|slic|hog> <input> <output_dir> [options]
+//   detect: --threshold N, --ethalons file.yml (classes: [{class: 1, features: [F1, F2]}, ...])
+//   slic:   --segments K, --balance M, --iterations N, --lab 0|1
+//   hog:    --block N, --cell N, --bins N
+//   all:    --threads N (cv::setNumThreads), --batch N (video frames processed in parallel)
+//
+// Outputs per image (<name> = file stem and extension, e.g. a_png, or frame_NNNNNN of a video):
+//   detect: <name>_labels.png (16-bit labels, 0 = background) and <name>_features.csv (features and class of every object)
+//   slic:   <name>_labels.png (16-bit superpixel index + 1, 0 = no superpixel) and <name>_superpixels.csv (statistics of every superpixel)
+//   hog:    <name>_hog.yml.gz (cells x (cells * bins) histogram)
+
+#define BATCH_VIDEO_FRAMES_DEFAULT (16)
+
+struct BatchOptions
+{
+    std::string mode;
+    std::string input;
+    std::filesystem::path output;
+
+    // detect
+    unsigned char threshold = 50;
+    std::string ethalons_path;
+    std::optional<ano::Ethalons> ethalons;
+
+    // slic
+    int segments = 18;
+    float balance = 25.0f;
+    int iterations = 200;
+    bool lab = false;
+
+    // hog
+    int block_size = 2;
+    int cell_size = 8;
+    int nbins = 9;
+
+    int threads = -1;
+    int video_batch = BATCH_VIDEO_FRAMES_DEFAULT;
+};
+
+// Parse command line arguments. Returns nothing and prints the usage when they are invalid.
+std::optional<BatchOptions> ParseOptions(int argc, char **argv);
+// Load classification ethalons from a FileStorage file.
+std::optional<ano::Ethalons> LoadEthalons(const std::string &filename);
+// List images in a directory (sorted by name). Returns an empty list when input is not a directory.
+std::vector<std::string> ListImages(const std::string &input);
+// Output name of an image file. The extension is kept so a.png and a.jpg do not overwrite each other.
+std::string OutputName(const std::string &filename);
+
+// Worker state reused for all images of one parallel range and, for a video, across its batches.
+class BatchWorker
+{
+public:
+    explicit BatchWorker(const BatchOptions &options);
+
+    // Process a single image and write its results. Returns false when the results could not be written.
+    bool Process(const cv::Mat &image, const std::string &name);
+
+private:
+    bool Detect(const cv::Mat &image, const std::string &name);
+    bool Slic(const cv::Mat &image, const std::string &name);
+    bool Hog(const cv::Mat &image, const std::string &name);
+
+    const BatchOptions &options;
+    ano::DetectionPipeline pipeline;
+    cv::Mat image_gray;
+    cv::Mat image_labels;
+    cv::Mat slic_labels;
+    ano::SLICSuperpixels superpixels;
+    cv::Mat hog;
+};
+
+// Process all images in parallel. Returns number of failed images.
+int ProcessImages(const BatchOptions &options, const std::vector<std::string> &filenames);
+// Decode video frames sequentially and process batches of them in parallel. Returns number of failed frames or -1 when the
+// video cannot be opened.
+int ProcessVideo(const BatchOptions &options);
+
+static std::mutex log_mutex;
+
+int main(int argc, char **argv)
+{
+    auto options_opt = ParseOptions(argc, argv);
+    if (!options_opt.has_value())
+    {
+        return 1;
+    }
+    auto &options = options_opt.value();
+
+    if (options.threads >= 0)
+    {
+        cv::setNumThreads(options.threads);
+    }
+
+    if (!options.ethalons_path.empty())
+    {
+        options.ethalons = LoadEthalons(options.ethalons_path);
+        if (!options.ethalons.has_value())
+        {
+            std::cerr << "Cannot load ethalons '" << options.ethalons_path << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.output, error);
+    if (error)
+    {
+        std::cerr << "Cannot create output directory '" << options.output.string() << "': " << error.message() << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    if (std::filesystem::is_directory(options.input))
+    {
+        auto filenames = ListImages(options.input);
+        std::cout << "Processing " << filenames.size() << " images from '" << options.input << "'" << std::endl;
+        failed = ProcessImages(options, filenames);
+    }
+    else if (cv::haveImageReader(options.input))
+    {
+        failed = ProcessImages(options, {options.input});
+    }
+    else
+    {
+        failed = ProcessVideo(options);
+        if (failed < 0)
+        {
+            std::cerr << "Cannot open '" << options.input << "' as a directory, an image or a video" << std::endl;
+            return 1;
+        }
+    }
+
+    if (failed > 0)
+    {
+        std::cerr << failed << " inputs failed" << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
+
+std::optional<BatchOptions> ParseOptions(int argc, char **argv)
+{
+    auto usage = [&]() -> std::optional<BatchOptions>
+    {
+        std::cerr << "Usage: " << argv[0] << " <detect|slic|hog> <input> <output_dir> [options]\n"
+                  << "  input: directory of images, an image or a video file\n"
+                  << "  detect: --threshold N (50), --ethalons file.yml\n"
+                  << "  slic: --segments K (18), --balance M (25), --iterations N (200), --lab 0|1 (0)\n"
+                  << "  hog: --block N (2), --cell N (8), --bins N (9)\n"
+                  << "  --threads N (OpenCV default), --batch N (" << BATCH_VIDEO_FRAMES_DEFAULT << " video frames)" << std::endl;
+        return {};
+    };
+
+    if (argc < 4)
+    {
+        return usage();
+    }
+
+    BatchOptions options;
+    options.mode = argv[1];
+    options.input = argv[2];
+    options.output = argv[3];
+
+    if (options.mode != "detect" && options.mode != "slic" && options.mode != "hog")
+    {
+        return usage();
+    }
+
+    for (int i = 4; i < argc; i++)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value of " << option << std::endl;
+            return usage();
+        }
+        const std::string value = argv[++i];
+
+        try
+        {
+            if (option == "--threshold")
+                options.threshold = static_cast<unsigned char>(std::clamp(std::stoi(value), 0, 255));
+            else if (option == "--ethalons")
+                options.ethalons_path = value;
+            else if (option == "--segments")
+                options.segments = std::stoi(value);
+            else if (option == "--balance")
+                options.balance = std::stof(value);
+            else if (option == "--iterations")
+                options.iterations = std::stoi(value);
+            else if (option == "--lab")
+                options.lab = std::stoi(value) != 0;
+            else if (option == "--block")
+                options.block_size = std::stoi(value);
+            else if (option == "--cell")
+                options.cell_size = std::stoi(value);
+            else if (option == "--bins")
+                options.nbins = std::stoi(value);
+            else if (option == "--threads")
+                options.threads = std::stoi(value);
+            else if (option == "--batch")
+                options.video_batch = std::max(1, std::stoi(value));
+            else
+            {
+                std::cerr << "Unknown option " << option << std::endl;
+                return usage();
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value '" << value << "' of " << option << std::endl;
+            return usage();
+        }
+    }
+
+    if (options.segments <= 0 || options.block_size <= 0 || options.cell_size <= 0 || options.nbins <= 0)
+    {
+        return usage();
+    }
+
+    return options;
+}
+
+std::optional<ano::Ethalons> LoadEthalons(const std::string &filename)
+{
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        return {};
+    }
+
+    ano::Ethalons ethalons;
+    for (const auto &node : fs["classes"])
+    {
+        std::vector<float> features;
+        node["features"] >> features;
+        ethalons.AddEthalons(static_cast<unsigned char>(static_cast<int>(node["class"])), features, ano::GenerateRandomColorBGR());
+    }
+
+    return ethalons;
+}
+
+std::vector<std::string> ListImages(const std::string &input)
+{
+    std::vector<std::string> filenames;
+
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(input, error))
+    {
+        if (entry.is_regular_file() && cv::haveImageReader(entry.path().string()))
+        {
+            filenames.push_back(entry.path().string());
+        }
+    }
+
+    std::sort(filenames.begin(), filenames.end());
+    return filenames;
+}
+
+std::string OutputName(const std::string &filename)
+{
+    const std::filesystem::path path(filename);
+    auto extension = path.extension().string();
+    if (extension.empty())
+    {
+        return path.stem().string();
+    }
+    return path.stem().string() + "_" + extension.substr(1);
+}
+
+BatchWorker::BatchWorker(const BatchOptions &options)
+    : options(options), pipeline(options.threshold)
+{
+    if (options.ethalons.has_value())
+    {
+        pipeline.SetEthalons(options.ethalons.value());
+    }
+}
+
+bool BatchWorker::Process(const cv::Mat &image, const std::string &name)
+{
+    if (options.mode == "detect")
+    {
+        return Detect(image, name);
+    }
+    if (options.mode == "slic")
+    {
+        return Slic(image, name);
+    }
+    return Hog(image, name);
+}
+
+bool BatchWorker::Detect(const cv::Mat &image, const std::string &name)
+{
+    if (image.channels() == 1)
+    {
+        image_gray = image;
+    }
+    else
+    {
+        cv::cvtColor(image, image_gray, cv::COLOR_BGR2GRAY);
+    }
+
+    const auto &objects = pipeline.Process(image_gray);
+    const auto &frame = pipeline.Frame();
+
+    // PNG stores at most 16 bits, labels above 65535 saturate
+    frame.image_labels.convertTo(image_labels, CV_16U);
+    bool written = cv::imwrite((options.output / (name + "_labels.png")).string(), image_labels);
+
+    std::ofstream csv(options.output / (name + "_features.csv"));
+    csv << "label,x,y,width,height,area,center_x,center_y,F1,F2,class\n";
+    for (const auto &object : objects)
+    {
+        csv << object.id_pixel << ',' << object.x << ',' << object.y << ',' << object.width << ',' << object.height << ','
+            << object.features.area << ',' << object.features.center_of_mass[0] << ',' << object.features.center_of_mass[1] << ','
+            << object.features.F1 << ',' << object.features.F2 << ',' << static_cast<int>(object.id_class) << '\n';
+    }
+    written &= static_cast<bool>(csv);
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << name << ": " << objects.size() << " objects" << std::endl;
+    return written;
+}
+
+bool BatchWorker::Slic(const cv::Mat &image, const std::string &name)
+{
+    if (image.channels() != 3)
+    {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::cerr << name << ": SLIC requires a BGR image" << std::endl;
+        return false;
+    }
+
+    // Files are already processed in parallel -> sequential SLIC
+    ano::SLICLabels(image, slic_labels, superpixels, options.segments, options.balance, options.iterations, options.lab ? SLIC_LAB : 0);
+
+    slic_labels.convertTo(image_labels, CV_16U, 1, 1);
+    bool written = cv::imwrite((options.output / (name + "_labels.png")).string(), image_labels);
+
+    std::ofstream csv(options.output / (name + "_superpixels.csv"));
+    csv << "label,count,color0,color1,color2,center_x,center_y,x,y,width,height\n";
+    for (int i = 0; i < static_cast<int>(superpixels.size()); i++)
+    {
+        const auto &superpixel = superpixels[i];
+        csv << i << ',' << superpixel.count << ',' << superpixel.mean_color[0] << ',' << superpixel.mean_color[1] << ',' << superpixel.mean_color[2] << ','
+            << superpixel.centroid.x << ',' << superpixel.centroid.y << ',' << superpixel.bounding_box.x << ',' << superpixel.bounding_box.y << ','
+            << superpixel.bounding_box.width << ',' << superpixel.bounding_box.height << '\n';
+    }
+    written &= static_cast<bool>(csv);
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << name << ": " << superpixels.size() << " superpixels" << std::endl;
+    return written;
+}
+
+bool BatchWorker::Hog(const cv::Mat &image, const std::string &name)
+{
+    if (image.channels() != 3)
+    {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::cerr << name << ": HoG requires a BGR image" << std::endl;
+        return false;
+    }
+
+    ano::HoG(image, hog, options.block_size, options.cell_size, options.nbins);
+    auto hog_flat = hog.reshape(1, std::vector<int>({hog.size[0], hog.size[1] * options.nbins})); // Keep the y size of HoG the same. Expand in x dir
+
+    cv::FileStorage fs((options.output / (name + "_hog.yml.gz")).string(), cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        return false;
+    }
+    fs << "cell_size" << options.cell_size << "block_size" << options.block_size << "nbins" << options.nbins << "hog" << hog_flat;
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << name << ": " << hog.size[1] << "x" << hog.size[0] << " cells" << std::endl;
+    return true;
+}
+
+int ProcessImages(const BatchOptions &options, const std::vector<std::string> &filenames)
+{
+    std::atomic<int> failed = 0;
+    const int flags = (options.mode == "detect") ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+
+    // One stripe per thread, every range creates its worker once and reuses it for all of its images
+    cv::parallel_for_(cv::Range(0, static_cast<int>(filenames.size())), [&](const cv::Range &range)
+                      {
+                          BatchWorker worker(options);
+                          for (int i = range.start; i < range.end; i++)
+                          {
+                              cv::Mat image = cv::imread(filenames[i], flags);
+                              if (image.empty())
+                              {
+                                  std::lock_guard<std::mutex> lock(log_mutex);
+                                  std::cerr << "Cannot read '" << filenames[i] << "'" << std::endl;
+                                  failed++;
+                                  continue;
+                              }
+
+                              if (!worker.Process(image, OutputName(filenames[i])))
+                              {
+                                  failed++;
+                              }
+                          } },
+                      static_cast<double>(cv::getNumThreads()));
+
+    return failed;
+}
+
+int ProcessVideo(const BatchOptions &options)
+{
+    cv::VideoCapture capture(options.input);
+    if (!capture.isOpened())
+    {
+        return -1;
+    }
+
+    std::atomic<int> failed = 0;
+    std::vector<cv::Mat> frames(options.video_batch);
+    int frame_index = 0;
+
+    // Workers idle between ranges, reused by all batches of the video (at most one per thread is ever created)
+    std::mutex workers_mutex;
+    std::vector<std::unique_ptr<BatchWorker>> workers;
+
+    while (true)
+    {
+        // The decoder is sequential, read a batch of frames and process them in parallel
+        int count = 0;
+        while (count < static_cast<int>(frames.size()) && capture.read(frames[count]))
+        {
+            if (options.mode == "detect" && frames[count].channels() != 1)
+            {
+                cv::cvtColor(frames[count], frames[count], cv::COLOR_BGR2GRAY);
+            }
+            count++;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+
+        // One stripe per thread, every range takes an idle worker (or creates one) and returns it when done
+        cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+                          {
+                              std::unique_ptr<BatchWorker> worker;
+                              {
+                                  std::lock_guard<std::mutex> lock(workers_mutex);
+                                  if (!workers.empty())
+                                  {
+                                      worker = std::move(workers.back());
+                                      workers.pop_back();
+                                  }
+                              }
+                              if (!worker)
+                              {
+                                  worker = std::make_unique<BatchWorker>(options);
+                              }
+
+                              for (int i = range.start; i < range.end; i++)
+                              {
+                                  char name[32];
+                                  std::snprintf(name, sizeof(name), "frame_%06d", frame_index + i);
+                                  if (!worker->Process(frames[i], name))
+                                  {
+                                      failed++;
+                                  }
+                              }
+
+                              std::lock_guard<std::mutex> lock(workers_mutex);
+                              workers.push_back(std::move(worker)); },
+                          static_cast<double>(cv::getNumThreads()));
+
+        frame_index += count;
+    }
+
+    std::cout << "Processed " << frame_index << " frames of '" << options.input << "'" << std::endl;
+    return failed;
+}
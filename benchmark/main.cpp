@@ -0,0 +1,659 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "moments.hpp"
+#include "floodfill.hpp"
+#include "threshold.hpp"
+#include "detection-pipeline.hpp"
+#include "slic.hpp"
+#include "image-gradient.hpp"
+#include "hog.hpp"
+#include "hog-detector.hpp"
+#include "backprop.hpp"
+
+// Benchmarks of the library kernels on synthetic frames. No windows are opened.
+// Usage: benchmark [section ...]. Runs all sections when none is given.
+
+#define BENCHMARK_REPEATS 5
+#define BENCHMARK_SLIC_IMG_PATH "../../img/slic_bears.jpg"
+
+// Runs the function BENCHMARK_REPEATS times and returns the best wall time in ms.
+double MeasureMs(const std::function<void()> &function);
+// Random binary image with blobs of the given color on 0 background.
+cv::Mat GenerateBlobs(int width, int height, int blob_count, unsigned char color = 255, unsigned int seed = 42);
+// BGR test image for SLIC: BENCHMARK_SLIC_IMG_PATH or random colored blobs when it is not found.
+cv::Mat LoadSLICImage();
+// Noisy BGR image of random colored disks. regions receives the ground truth region of every pixel (CV_32SC1).
+cv::Mat GenerateRegions(int width, int height, int disk_count, cv::Mat &regions, unsigned int seed = 42);
+// Fraction of the boundary pixels of reference with a boundary pixel of labels at most tolerance pixels away (boundary recall).
+double BoundaryRecall(const cv::Mat &labels, const cv::Mat &reference, int tolerance = 2);
+
+void BenchmarkMoments();
+void BenchmarkLabeling();
+void BenchmarkThreshold();
+void BenchmarkPipeline();
+void BenchmarkSLIC();
+void BenchmarkSLICPyramid();
+void BenchmarkGradient();
+void BenchmarkHoG();
+void BenchmarkHoGDetector();
+void BenchmarkBPNN();
+
+int main(int argc, char **argv)
+{
+    std::vector<std::pair<std::string, std::function<void()>>> sections = {
+        {"moments", BenchmarkMoments},
+        {"labeling", BenchmarkLabeling},
+        {"threshold", BenchmarkThreshold},
+        {"pipeline", BenchmarkPipeline},
+        {"slic", BenchmarkSLIC},
+        {"slic-pyramid", BenchmarkSLICPyramid},
+        {"gradient", BenchmarkGradient},
+        {"hog", BenchmarkHoG},
+        {"detector", BenchmarkHoGDetector},
+        {"bpnn", BenchmarkBPNN},
+    };
+
+    for (const auto &[name, function] : sections)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++)
+        {
+            selected |= name == argv[i];
+        }
+
+        if (selected)
+        {
+            std::cout << "=== " << name << " ===" << std::endl;
+            function();
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+double MeasureMs(const std::function<void()> &function)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < BENCHMARK_REPEATS; i++)
+    {
+        cv::TickMeter tm;
+        tm.start();
+        function();
+        tm.stop();
+        best = std::min(best, tm.getTimeMilli());
+    }
+
+    return best;
+}
+
+cv::Mat GenerateBlobs(int width, int height, int blob_count, unsigned char color, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> distr_x(0, width - 1);
+    std::uniform_int_distribution<int> distr_y(0, height - 1);
+    std::uniform_int_distribution<int> distr_r(2, std::max(3, std::min(width, height) / 40));
+
+    cv::Mat img(height, width, CV_8UC1, cv::Scalar(0));
+    for (int i = 0; i < blob_count; i++)
+    {
+        cv::circle(img, cv::Point(distr_x(generator), distr_y(generator)), distr_r(generator), cv::Scalar(color), cv::FILLED);
+    }
+
+    return img;
+}
+
+// The per-pixel std::pow moment with int accumulation the compile time kernels replaced
+int ReferenceMoment(const cv::Mat &img, unsigned char p, unsigned char q, unsigned char color)
+{
+    int sum = 0;
+    for (int y = 0; y < img.size[0]; ++y)
+    {
+        for (int x = 0; x < img.size[1]; ++x)
+        {
+            if (img.at<unsigned char>(y, x) == color)
+            {
+                sum += std::pow(x, p) * std::pow(y, q);
+            }
+        }
+    }
+
+    return sum;
+}
+
+void BenchmarkMoments()
+{
+    // 4K frame
+    auto img = GenerateBlobs(3840, 2160, 200);
+    unsigned char color = 255;
+
+    long long m20 = 0;
+    int m20_reference = 0;
+    double u20 = 0.0, u11 = 0.0, u02 = 0.0;
+
+    auto reference_ms = MeasureMs([&]()
+                                  { m20_reference = ReferenceMoment(img, 2, 0, color); });
+    auto kernel_ms = MeasureMs([&]()
+                               { m20 = ano::Moment<2, 0>(img, color); });
+    auto centered_ms = MeasureMs([&]()
+                                 {
+                                     u20 = ano::CenteredMoment<2, 0>(img, color);
+                                     u11 = ano::CenteredMoment<1, 1>(img, color);
+                                     u02 = ano::CenteredMoment<0, 2>(img, color); });
+
+    std::cout << "m20 std::pow reference: " << reference_ms << " ms (value " << m20_reference << ")\n"
+              << "m20 compile time kernel: " << kernel_ms << " ms (value " << m20 << ")\n"
+              << "u20 + u11 + u02 kernels: " << centered_ms << " ms (" << u20 << ", " << u11 << ", " << u02 << ")\n"
+              << "Speedup m20: " << reference_ms / kernel_ms << "x" << std::endl;
+}
+
+void BenchmarkLabeling()
+{
+    // 20 MP frame
+    auto img = GenerateBlobs(5472, 3648, 5000);
+
+    cv::Mat labels, labels_parallel;
+    ano::ConnectedComponentsVector components, components_parallel;
+
+    int count = 0;
+    auto sequential_ms = MeasureMs([&]()
+                                   { count = ano::LabelConnectedComponents(img, labels, components); });
+    std::cout << "Sequential: " << sequential_ms << " ms (" << count << " components)" << std::endl;
+
+    // Scaling with the number of threads
+    auto threads_default = cv::getNumThreads();
+    for (int threads = 1; threads <= cv::getNumberOfCPUs(); threads *= 2)
+    {
+        cv::setNumThreads(threads);
+
+        int count_parallel = 0;
+        auto parallel_ms = MeasureMs([&]()
+                                     { count_parallel = ano::LabelConnectedComponentsParallel(img, labels_parallel, components_parallel, 255, threads); });
+
+        // Both variants must produce the same labels
+        bool same = count_parallel == count;
+        for (int y = 0; same && y < labels.size[0]; y++)
+        {
+            same = std::equal(labels.ptr<int>(y), labels.ptr<int>(y) + labels.size[1], labels_parallel.ptr<int>(y));
+        }
+
+        std::cout << "Parallel " << threads << " threads: " << parallel_ms << " ms, speedup " << sequential_ms / parallel_ms << "x" << (same ? "" : " MISMATCH") << std::endl;
+    }
+    cv::setNumThreads(threads_default);
+}
+
+void BenchmarkThreshold()
+{
+    // 20 MP grayscale frame
+    cv::Mat img(3648, 5472, CV_8UC1);
+    std::mt19937 generator(42);
+    for (int y = 0; y < img.size[0]; y++)
+    {
+        for (int x = 0; x < img.size[1]; x++)
+        {
+            img.at<unsigned char>(y, x) = static_cast<unsigned char>(generator());
+        }
+    }
+
+    cv::Mat img_threshold, labels;
+    ano::ConnectedComponentsVector components;
+
+    auto threshold_ms = MeasureMs([&]()
+                                  { ano::Threshold(img, img_threshold, 128); });
+    auto otsu_ms = MeasureMs([&]()
+                             { ano::ThresholdOtsu(img, img_threshold); });
+    auto separate_ms = MeasureMs([&]()
+                                 {
+                                     ano::Threshold(img, img_threshold, 128);
+                                     ano::LabelConnectedComponents(img_threshold, labels, components); });
+    auto fused_ms = MeasureMs([&]()
+                              { ano::LabelConnectedComponentsThreshold(img, labels, components, 128); });
+
+    // Read + write of every pixel
+    auto gigabytes = 2.0 * img.total() / 1e9;
+    std::cout << "Threshold: " << threshold_ms << " ms (" << gigabytes / (threshold_ms / 1000.0) << " GB/s)\n"
+              << "Otsu threshold: " << otsu_ms << " ms\n"
+              << "Threshold + labeling: " << separate_ms << " ms\n"
+              << "Fused threshold labeling: " << fused_ms << " ms" << std::endl;
+}
+
+void BenchmarkPipeline()
+{
+    // Stream of 1080p grayscale frames
+    constexpr int frame_count = 32;
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < frame_count; i++)
+    {
+        frames.push_back(GenerateBlobs(1920, 1080, 300, 200, i));
+    }
+
+    // The threshold is not fused, so every stage has work to do
+    ano::DetectionPipeline pipeline(50, false);
+    size_t objects_sequential = 0;
+    auto sequential_ms = MeasureMs([&]()
+                                   {
+                                       objects_sequential = 0;
+                                       for (const auto &frame : frames)
+                                       {
+                                           objects_sequential += pipeline.Process(frame).size();
+                                       } });
+
+    size_t objects_streaming = 0;
+    auto streaming_ms = MeasureMs([&]()
+                                  {
+                                      ano::StreamingDetectionPipeline streaming(pipeline);
+                                      std::thread producer([&]()
+                                                           {
+                                                               for (const auto &frame : frames)
+                                                               {
+                                                                   streaming.Push(frame);
+                                                               }
+                                                               streaming.Close(); });
+
+                                      objects_streaming = 0;
+                                      while (const auto *frame = streaming.Pop())
+                                      {
+                                          objects_streaming += frame->objects.size();
+                                          streaming.Release(frame);
+                                      }
+                                      producer.join(); });
+
+    std::cout << "Sequential: " << frame_count * 1000.0 / sequential_ms << " frames/s\n"
+              << "Streaming (" << std::thread::hardware_concurrency() << " cores): " << frame_count * 1000.0 / streaming_ms << " frames/s"
+              << (objects_sequential == objects_streaming ? "" : " MISMATCH") << std::endl;
+}
+
+cv::Mat LoadSLICImage()
+{
+    cv::Mat img = cv::imread(BENCHMARK_SLIC_IMG_PATH, cv::IMREAD_COLOR);
+    if (!img.empty())
+    {
+        return img;
+    }
+
+    std::cout << "'" << BENCHMARK_SLIC_IMG_PATH << "' not found, using a synthetic image" << std::endl;
+    img = cv::Mat(321, 481, CV_8UC3, cv::Scalar(40, 90, 60));
+    std::mt19937 generator(42);
+    for (int i = 0; i < 200; i++)
+    {
+        cv::Scalar color(generator() % 256, generator() % 256, generator() % 256);
+        cv::circle(img, cv::Point(generator() % img.size[1], generator() % img.size[0]), 5 + generator() % 30, color, cv::FILLED);
+    }
+    return img;
+}
+
+void BenchmarkSLIC()
+{
+    cv::Mat img = LoadSLICImage();
+
+    for (int iterations : {10, 50})
+    {
+        auto slic_ms = MeasureMs([&]()
+                                 { ano::SLIC(img, 400, 25, iterations); });
+        auto parallel_ms = MeasureMs([&]()
+                                     { ano::SLIC(img, 400, 25, iterations, false, SLIC_PARALLEL); });
+        std::cout << "SLIC k=400, " << iterations << " iterations: " << slic_ms << " ms, parallel (" << cv::getNumThreads() << " threads): " << parallel_ms << " ms" << std::endl;
+    }
+
+    // Static camera: the first frame starts from a grid, the following ones from the previous segmentation
+    ano::TemporalSLIC temporal(400, 25, 0, SLIC_TEMPORAL_REFINE_ITERATIONS, 50);
+    temporal.Process(img);
+    auto temporal_ms = MeasureMs([&]()
+                                 { temporal.Process(img); });
+    std::cout << "Temporal SLIC k=400, " << SLIC_TEMPORAL_REFINE_ITERATIONS << " refinement iterations per frame: " << temporal_ms << " ms" << std::endl;
+}
+
+cv::Mat GenerateRegions(int width, int height, int disk_count, cv::Mat &regions, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> distr_x(0, width - 1);
+    std::uniform_int_distribution<int> distr_y(0, height - 1);
+    std::uniform_int_distribution<int> distr_r(std::min(width, height) / 60, std::min(width, height) / 8);
+    std::uniform_int_distribution<int> distr_color(0, 255);
+    std::uniform_int_distribution<int> distr_noise(-12, 12);
+
+    // Later disks cover the earlier ones, region 0 is the background
+    regions = cv::Mat(height, width, CV_32SC1, cv::Scalar(0));
+    std::vector<cv::Vec3b> colors = {cv::Vec3b(90, 120, 60)};
+    for (int i = 1; i <= disk_count; i++)
+    {
+        cv::circle(regions, cv::Point(distr_x(generator), distr_y(generator)), distr_r(generator), cv::Scalar(i), cv::FILLED);
+        colors.emplace_back(distr_color(generator), distr_color(generator), distr_color(generator));
+    }
+
+    cv::Mat img(height, width, CV_8UC3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const auto &color = colors[regions.at<int>(y, x)];
+            for (int c = 0; c < 3; c++)
+            {
+                img.at<cv::Vec3b>(y, x)[c] = static_cast<unsigned char>(std::clamp(color[c] + distr_noise(generator), 0, 255));
+            }
+        }
+    }
+
+    return img;
+}
+
+double BoundaryRecall(const cv::Mat &labels, const cv::Mat &reference, int tolerance)
+{
+    // A pixel is on a boundary when its right or bottom neighbour has a different label
+    auto boundaries = [](const cv::Mat &map)
+    {
+        cv::Mat boundary(map.size(), CV_8UC1, cv::Scalar(0));
+        for (int y = 0; y < map.size[0]; y++)
+        {
+            for (int x = 0; x < map.size[1]; x++)
+            {
+                const int label = map.at<int>(y, x);
+                if ((x + 1 < map.size[1] && map.at<int>(y, x + 1) != label) || (y + 1 < map.size[0] && map.at<int>(y + 1, x) != label))
+                {
+                    boundary.at<unsigned char>(y, x) = 1;
+                }
+            }
+        }
+        return boundary;
+    };
+
+    const cv::Mat boundary = boundaries(labels);
+    const cv::Mat boundary_reference = boundaries(reference);
+
+    long long count = 0, recalled = 0;
+    for (int y = 0; y < boundary.size[0]; y++)
+    {
+        for (int x = 0; x < boundary.size[1]; x++)
+        {
+            if (!boundary_reference.at<unsigned char>(y, x))
+            {
+                continue;
+            }
+
+            count++;
+            bool found = false;
+            for (int dy = -tolerance; dy <= tolerance && !found; dy++)
+            {
+                for (int dx = -tolerance; dx <= tolerance && !found; dx++)
+                {
+                    const int yy = y + dy, xx = x + dx;
+                    found = yy >= 0 && xx >= 0 && yy < boundary.size[0] && xx < boundary.size[1] && boundary.at<unsigned char>(yy, xx);
+                }
+            }
+            recalled += found;
+        }
+    }
+
+    return count ? static_cast<double>(recalled) / count : 1.0;
+}
+
+void BenchmarkSLICPyramid()
+{
+    cv::Mat regions;
+    cv::Mat img = GenerateRegions(1280, 960, 150, regions);
+
+    const int k = 2000;
+    const float m = 25;
+    const int iterations = 10;
+
+    cv::Mat labels_single, labels_pyramid;
+    ano::SLICSuperpixels superpixels;
+
+    auto single_ms = MeasureMs([&]()
+                               { ano::SLICLabels(img, labels_single, superpixels, k, m, iterations); });
+    auto pyramid_ms = MeasureMs([&]()
+                                { ano::SLICLabels(img, labels_pyramid, superpixels, k, m, iterations, SLIC_PYRAMID); });
+
+    std::cout << "1280x960, k=" << k << ", " << iterations << " iterations\n"
+              << "Single level: " << single_ms << " ms, boundary recall " << BoundaryRecall(labels_single, regions) << "\n"
+              << "Pyramid: " << pyramid_ms << " ms, boundary recall " << BoundaryRecall(labels_pyramid, regions) << "\n"
+              << "Pyramid recall of single level boundaries: " << BoundaryRecall(labels_pyramid, labels_single) << std::endl;
+}
+
+void BenchmarkGradient()
+{
+    cv::Mat regions, img_greyscale;
+    cv::Mat img = GenerateRegions(1920, 1080, 150, regions);
+    cv::cvtColor(img, img_greyscale, cv::COLOR_BGR2GRAY);
+
+    cv::Mat gradients, orientation, magnitude, bins;
+    auto interleaved_ms = MeasureMs([&]()
+                                    { gradients = ano::ComputeGradients(img_greyscale); });
+    auto parallel_ms = MeasureMs([&]()
+                                 { gradients = ano::ComputeGradients(img_greyscale, GRADIENT_PARALLEL); });
+    auto planar_ms = MeasureMs([&]()
+                               { ano::ComputeGradients(img_greyscale, orientation, magnitude); });
+    auto bins_ms = MeasureMs([&]()
+                             { ano::ComputeGradientBins(img_greyscale, bins, magnitude, 9); });
+
+    // Reference: std::atan2 per pixel
+    cv::Mat reference(img.size(), CV_32FC2);
+    auto reference_ms = MeasureMs([&]()
+                                  {
+                                      for (int y = 0; y < img.size[0]; y++)
+                                      {
+                                          auto src_y = std::min(y, img.size[0] - 2);
+                                          const unsigned char *row = img_greyscale.ptr<unsigned char>(src_y);
+                                          const unsigned char *row_below = img_greyscale.ptr<unsigned char>(src_y + 1);
+                                          for (int x = 0; x < img.size[1]; x++)
+                                          {
+                                              auto src_x = std::min(x, img.size[1] - 2);
+                                              int dX = row[src_x + 1] - row[src_x];
+                                              int dY = row_below[src_x] - row[src_x];
+                                              reference.at<cv::Vec2f>(y, x) = cv::Vec2f(std::atan2(dY, dX), std::sqrt(dX * dX + dY * dY));
+                                          }
+                                      } });
+
+    float max_error = 0.0f;
+    for (int y = 0; y < img.size[0]; y++)
+    {
+        for (int x = 0; x < img.size[1]; x++)
+        {
+            max_error = std::max(max_error, std::abs(gradients.at<cv::Vec2f>(y, x)[0] - reference.at<cv::Vec2f>(y, x)[0]));
+        }
+    }
+
+    std::cout << "1920x1080 greyscale\n"
+              << "std::atan2 reference: " << reference_ms << " ms\n"
+              << "Interleaved: " << interleaved_ms << " ms, max orientation error " << max_error << " rad\n"
+              << "Interleaved parallel (" << cv::getNumThreads() << " threads): " << parallel_ms << " ms\n"
+              << "Planar: " << planar_ms << " ms\n"
+              << "Bins: " << bins_ms << " ms" << std::endl;
+}
+
+void BenchmarkHoG()
+{
+    cv::Mat regions;
+    cv::Mat img = GenerateRegions(3840, 2160, 300, regions);
+
+    cv::Mat hog;
+    auto two_pass_ms = MeasureMs([&]()
+                                 { hog = ano::HoG(ano::ComputeGradients(img), 2, 8, 9); });
+    auto fused_ms = MeasureMs([&]()
+                              { hog = ano::HoG(img, 2, 8, 9); });
+    auto reused_ms = MeasureMs([&]()
+                               { ano::HoG(img, hog, 2, 8, 9); });
+    auto parallel_ms = MeasureMs([&]()
+                                 { ano::HoG(img, hog, 2, 8, 9, HOG_PARALLEL); });
+
+    std::cout << "3840x2160 BGR, 8x8 cells, 2x2 blocks, 9 bins\n"
+              << "Gradient image + HoG: " << two_pass_ms << " ms\n"
+              << "Fused HoG: " << fused_ms << " ms\n"
+              << "Fused HoG into a reused buffer: " << reused_ms << " ms\n"
+              << "Parallel fused HoG (" << cv::getNumThreads() << " threads): " << parallel_ms << " ms" << std::endl;
+
+    // Sliding 64x128 windows over a 1920x1080 frame, every window scored against random weights
+    cv::Mat frame;
+    cv::resize(img, frame, cv::Size(1920, 1080), 0, 0, cv::INTER_AREA);
+    const cv::Size window_cells(8, 16);
+
+    ano::HoGDescriptorGrid grid;
+    grid.Compute(frame);
+    std::vector<float> weights(grid.DescriptorLength(window_cells));
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    for (auto &weight : weights)
+    {
+        weight = distribution(generator);
+    }
+
+    const auto window_count = grid.WindowCount(window_cells);
+    float best_score = 0.0f;
+    auto dense_ms = MeasureMs([&]()
+                              {
+                                  grid.Compute(frame);
+                                  for (int y = 0; y < window_count.height; y++)
+                                  {
+                                      for (int x = 0; x < window_count.width; x++)
+                                      {
+                                          auto window = grid.Window(x, y, window_cells);
+                                          const float *weight = weights.data();
+                                          float score = 0.0f;
+                                          for (int row = 0; row < window.size[0]; row++, weight += window.size[1])
+                                          {
+                                              const float *descriptor = window.ptr<float>(row);
+                                              for (int i = 0; i < window.size[1]; i++)
+                                              {
+                                                  score += descriptor[i] * weight[i];
+                                              }
+                                          }
+                                          best_score = std::max(best_score, score);
+                                      }
+                                  } });
+
+    // Per window extraction on a sample of the windows, extrapolated
+    const int sample_count = 100;
+    ano::HoGDescriptorGrid window_grid;
+    auto per_window_ms = MeasureMs([&]()
+                                   {
+                                       for (int i = 0; i < sample_count; i++)
+                                       {
+                                           auto x = (i * 37) % window_count.width, y = (i * 11) % window_count.height;
+                                           window_grid.Compute(frame(cv::Rect(x * 8, y * 8, 64, 128)));
+                                       } }) *
+                         window_count.area() / sample_count;
+
+    std::cout << "1920x1080, " << window_count.area() << " windows of 64x128 (" << weights.size() << " floats)\n"
+              << "Dense grid + scoring all windows: " << dense_ms << " ms (best score " << best_score << ")\n"
+              << "HoG per window (extrapolated): " << per_window_ms << " ms" << std::endl;
+
+    // All levels down to the window size, levels in parallel vs one after another
+    ano::HoGPyramid pyramid;
+    pyramid.Compute(frame, cv::Size(64, 128));
+    std::vector<cv::Mat> level_images(pyramid.LevelCount());
+    auto pyramid_ms = MeasureMs([&]()
+                                { pyramid.Compute(frame, cv::Size(64, 128)); });
+    auto sequential_ms = MeasureMs([&]()
+                                   {
+                                       for (int level = 0; level < pyramid.LevelCount(); level++)
+                                       {
+                                           cv::resize(frame, level_images[level], pyramid.Image(level).size(), 0, 0, cv::INTER_AREA);
+                                           window_grid.Compute(level_images[level]);
+                                       } });
+
+    std::cout << "Pyramid of " << pyramid.LevelCount() << " levels (" << cv::getNumThreads() << " threads): " << pyramid_ms << " ms\n"
+              << "Levels one after another: " << sequential_ms << " ms" << std::endl;
+}
+
+void BenchmarkHoGDetector()
+{
+    cv::Mat regions;
+    cv::Mat frame = GenerateRegions(1920, 1080, 150, regions);
+
+    // Any weights do for timing: train on random crops labeled by the region under their center
+    ano::HoGDetector detector;
+    std::vector<cv::Mat> positives, negatives;
+    std::mt19937 generator(42);
+    for (int i = 0; i < 200; i++)
+    {
+        int x = static_cast<int>(generator() % (frame.size[1] - 64));
+        int y = static_cast<int>(generator() % (frame.size[0] - 128));
+        auto crop = frame(cv::Rect(x, y, 64, 128));
+        (regions.at<int>(y + 64, x + 32) % 2 ? positives : negatives).push_back(crop);
+    }
+    auto train_ms = MeasureMs([&]()
+                              { detector.Train(positives, negatives); });
+
+    size_t detection_count = 0;
+    ano::HoGPyramid pyramid;
+    auto pyramid_ms = MeasureMs([&]()
+                                { pyramid.Compute(frame, detector.WindowSize()); });
+    auto detect_ms = MeasureMs([&]()
+                               { detection_count = detector.Detect(frame).size(); });
+
+    int window_count = 0;
+    for (int level = 0; level < detector.Pyramid().LevelCount(); level++)
+    {
+        window_count += detector.Pyramid().Grid(level).WindowCount(cv::Size(8, 16)).area();
+    }
+
+    std::cout << "Training on " << positives.size() + negatives.size() << " windows: " << train_ms << " ms\n"
+              << "1920x1080, " << detector.Pyramid().LevelCount() << " levels, " << window_count << " windows of 64x128\n"
+              << "HoG pyramid: " << pyramid_ms << " ms\n"
+              << "Detect (pyramid + scoring + NMS): " << detect_ms << " ms, " << detection_count << " detections" << std::endl;
+}
+
+void BenchmarkBPNN()
+{
+    // MNIST sized problem: 784 inputs, 128 hidden neurons, 10 classes, random samples with one hot targets
+    constexpr int n_in = 784, n_hidden = 128, n_out = 10;
+    constexpr int sample_count = 4096, batch = 32;
+
+    std::vector<double> inputs(sample_count * n_in), targets(sample_count * n_out, 0.0), outputs(sample_count * n_out);
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    for (auto &input : inputs)
+    {
+        input = distribution(generator);
+    }
+    for (int i = 0; i < sample_count; i++)
+    {
+        targets[i * n_out + generator() % n_out] = 1.0;
+    }
+
+    ano::bpnn::NN *nn = ano::bpnn::createNN(n_in, n_hidden, n_out);
+
+    auto inference_ms = MeasureMs([&]()
+                                  {
+                                      for (int i = 0; i < sample_count; i++)
+                                      {
+                                          ano::bpnn::setInput(nn, &inputs[i * n_in]);
+                                          ano::bpnn::feedforward(nn);
+                                      } });
+    auto inference_batch_ms = MeasureMs([&]()
+                                        {
+                                            for (int i = 0; i < sample_count; i += batch)
+                                            {
+                                                ano::bpnn::feedforwardBatch(nn, &inputs[i * n_in], batch, &outputs[i * n_out]);
+                                            } });
+    auto epoch_ms = MeasureMs([&]()
+                              {
+                                  for (int i = 0; i < sample_count; i++)
+                                  {
+                                      ano::bpnn::setInput(nn, &inputs[i * n_in]);
+                                      ano::bpnn::feedforward(nn);
+                                      ano::bpnn::backpropagation(nn, &targets[i * n_out]);
+                                  } });
+    auto epoch_batch_ms = MeasureMs([&]()
+                                    {
+                                        for (int i = 0; i < sample_count; i += batch)
+                                        {
+                                            ano::bpnn::trainBatch(nn, &inputs[i * n_in], &targets[i * n_out], batch);
+                                        } });
+
+    ano::bpnn::releaseNN(nn);
+
+    std::cout << sample_count << " samples, " << n_in << "-" << n_hidden << "-" << n_out << " network\n"
+              << "Feedforward per sample: " << inference_ms << " ms\n"
+              << "Feedforward in batches of " << batch << ": " << inference_batch_ms << " ms\n"
+              << "Training epoch per sample: " << epoch_ms << " ms\n"
+              << "Training epoch in batches of " << batch << ": " << epoch_batch_ms << " ms" << std::endl;
+}
@@ -4,6 +4,12 @@
 #include <math.h>
 #include <string.h>
 #include <vector>
+#include <algorithm>
+
+#if defined(ANO_ENABLE_AVX2)
+#include <immintrin.h>
+#define BPNN_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
 
 #include "backprop.hpp"
 
@@ -15,6 +21,23 @@ namespace ano::bpnn
 
 #define SQR(x) ((x) * (x))
 
+	// Weight rows and layer vectors are padded to a multiple of BPNN_LANES doubles and aligned to BPNN_ALIGNMENT bytes,
+	// so the kernels below run whole AVX vectors without a remainder loop (padding is kept at zero)
+#define BPNN_LANES (4)
+#define BPNN_ALIGNMENT (32)
+
+	int alignedLength(int n)
+	{
+		return (n + BPNN_LANES - 1) / BPNN_LANES * BPNN_LANES;
+	}
+
+	double *allocVector(int n)
+	{
+		auto p = static_cast<double *>(aligned_alloc(BPNN_ALIGNMENT, sizeof(double) * n));
+		memset(p, 0, sizeof(double) * n);
+		return p;
+	}
+
 	void randomize(double *p, int n)
 	{
 		for (int i = 0; i < n; i++)
@@ -23,6 +46,386 @@ namespace ano::bpnn
 		}
 	}
 
+	// AVX2/FMA kernels are compiled with a function level target (only with ANO_ENABLE_AVX2 from bpnn/CMakeLists.txt)
+	// and only run on CPUs that support them, everything else is built for the baseline instruction set
+#if defined(ANO_ENABLE_AVX2)
+	static bool hasAVX2()
+	{
+		static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		return supported;
+	}
+#endif
+
+	// y = W * x, W has rows rows of length s (s is a multiple of BPNN_LANES, rows are aligned)
+	static void gemvScalar(const double *W, int rows, int s, const double *x, double *y)
+	{
+		for (int i = 0; i < rows; i++)
+		{
+			const double *wi = W + (size_t)i * s;
+			double sum = 0;
+			for (int j = 0; j < s; j++)
+			{
+				sum += wi[j] * x[j];
+			}
+			y[i] = sum;
+		}
+	}
+
+	// y[0..s) += a * x[0..s)
+	static void axpyScalar(double *y, double a, const double *x, int s)
+	{
+		for (int j = 0; j < s; j++)
+		{
+			y[j] += a * x[j];
+		}
+	}
+
+#if defined(ANO_ENABLE_AVX2)
+	BPNN_AVX2_TARGET static inline double hsum(__m256d v)
+	{
+		__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+
+	BPNN_AVX2_TARGET static void gemvAVX2(const double *W, int rows, int s, const double *x, double *y)
+	{
+		int i = 0;
+		// Four rows at once share every load of x
+		for (; i + 4 <= rows; i += 4)
+		{
+			const double *w0 = W + (size_t)i * s;
+			const double *w1 = w0 + s;
+			const double *w2 = w1 + s;
+			const double *w3 = w2 + s;
+			__m256d acc0 = _mm256_setzero_pd();
+			__m256d acc1 = _mm256_setzero_pd();
+			__m256d acc2 = _mm256_setzero_pd();
+			__m256d acc3 = _mm256_setzero_pd();
+			for (int j = 0; j < s; j += BPNN_LANES)
+			{
+				__m256d xv = _mm256_load_pd(x + j);
+				acc0 = _mm256_fmadd_pd(_mm256_load_pd(w0 + j), xv, acc0);
+				acc1 = _mm256_fmadd_pd(_mm256_load_pd(w1 + j), xv, acc1);
+				acc2 = _mm256_fmadd_pd(_mm256_load_pd(w2 + j), xv, acc2);
+				acc3 = _mm256_fmadd_pd(_mm256_load_pd(w3 + j), xv, acc3);
+			}
+			y[i] = hsum(acc0);
+			y[i + 1] = hsum(acc1);
+			y[i + 2] = hsum(acc2);
+			y[i + 3] = hsum(acc3);
+		}
+		for (; i < rows; i++)
+		{
+			const double *wi = W + (size_t)i * s;
+			__m256d acc = _mm256_setzero_pd();
+			for (int j = 0; j < s; j += BPNN_LANES)
+			{
+				acc = _mm256_fmadd_pd(_mm256_load_pd(wi + j), _mm256_load_pd(x + j), acc);
+			}
+			y[i] = hsum(acc);
+		}
+	}
+
+	BPNN_AVX2_TARGET static void axpyAVX2(double *y, double a, const double *x, int s)
+	{
+		__m256d av = _mm256_set1_pd(a);
+		for (int j = 0; j < s; j += BPNN_LANES)
+		{
+			_mm256_store_pd(y + j, _mm256_fmadd_pd(av, _mm256_load_pd(x + j), _mm256_load_pd(y + j)));
+		}
+	}
+#endif
+
+	static void gemv(const double *W, int rows, int s, const double *x, double *y)
+	{
+#if defined(ANO_ENABLE_AVX2)
+		if (hasAVX2())
+		{
+			gemvAVX2(W, rows, s, x, y);
+			return;
+		}
+#endif
+		gemvScalar(W, rows, s, x, y);
+	}
+
+	static auto axpyKernel()
+	{
+#if defined(ANO_ENABLE_AVX2)
+		if (hasAVX2())
+		{
+			return &axpyAVX2;
+		}
+#endif
+		return &axpyScalar;
+	}
+
+	// y = W^T * x, accumulated row by row so W is still read contiguously
+	static void gemvTransposed(const double *W, int rows, int s, const double *x, double *y)
+	{
+		auto axpy = axpyKernel();
+		memset(y, 0, sizeof(double) * s);
+		for (int j = 0; j < rows; j++)
+		{
+			axpy(y, x[j], W + (size_t)j * s, s);
+		}
+	}
+
+	// W += x * y^T (rank-1 update, x has rows entries, y has s entries)
+	static void ger(double *W, int rows, int s, const double *x, const double *y)
+	{
+		auto axpy = axpyKernel();
+		for (int j = 0; j < rows; j++)
+		{
+			axpy(W + (size_t)j * s, x[j], y, s);
+		}
+	}
+
+	// Mini-batch products are cache blocked: BPNN_BLOCK_K steps of the reduction over BPNN_BLOCK_N rows (columns) of
+	// the right hand matrix keep its panel (256 x 64 doubles = 128 kB) in L2 while all rows of the left matrix stream over it
+#define BPNN_BLOCK_K (256)
+#define BPNN_BLOCK_N (64)
+
+	// Register tiles of the blocked products, the blocking is shared by the scalar and the AVX2 kernels
+	struct ScalarTiles
+	{
+		// C[MR x NR] += A[MR x k0..k1] * B[NR x k0..k1]^T
+		template <int MR, int NR>
+		static void NT(const double *A, int lda, const double *B, int ldb, double *C, int ldc, int k0, int k1)
+		{
+			for (int r = 0; r < MR; r++)
+			{
+				for (int c = 0; c < NR; c++)
+				{
+					double sum = 0;
+					for (int k = k0; k < k1; k++)
+					{
+						sum += A[(size_t)r * lda + k] * B[(size_t)c * ldb + k];
+					}
+					C[(size_t)r * ldc + c] += sum;
+				}
+			}
+		}
+
+		// C[MR x NV * BPNN_LANES] += alpha * A[MR x k0..k1] * B[k0..k1 x NV * BPNN_LANES], A(m, k) = A[m * ars + k * acs]
+		template <int MR, int NV>
+		static void NN(const double *A, int ars, int acs, const double *B, int ldb, double *C, int ldc, int k0, int k1, double alpha)
+		{
+			for (int r = 0; r < MR; r++)
+			{
+				double acc[NV * BPNN_LANES] = {};
+				for (int k = k0; k < k1; k++)
+				{
+					double a = A[(size_t)r * ars + (size_t)k * acs];
+					for (int c = 0; c < NV * BPNN_LANES; c++)
+					{
+						acc[c] += a * B[(size_t)k * ldb + c];
+					}
+				}
+				for (int c = 0; c < NV * BPNN_LANES; c++)
+				{
+					C[(size_t)r * ldc + c] += alpha * acc[c];
+				}
+			}
+		}
+	};
+
+#if defined(ANO_ENABLE_AVX2)
+	struct AVX2Tiles
+	{
+		// Rows of A and B are aligned and k0, k1 are multiples of BPNN_LANES
+		template <int MR, int NR>
+		BPNN_AVX2_TARGET static void NT(const double *A, int lda, const double *B, int ldb, double *C, int ldc, int k0, int k1)
+		{
+			__m256d acc[MR][NR];
+			for (int r = 0; r < MR; r++)
+			{
+				for (int c = 0; c < NR; c++)
+				{
+					acc[r][c] = _mm256_setzero_pd();
+				}
+			}
+
+			for (int k = k0; k < k1; k += BPNN_LANES)
+			{
+				__m256d b[NR];
+				for (int c = 0; c < NR; c++)
+				{
+					b[c] = _mm256_load_pd(B + (size_t)c * ldb + k);
+				}
+				for (int r = 0; r < MR; r++)
+				{
+					__m256d a = _mm256_load_pd(A + (size_t)r * lda + k);
+					for (int c = 0; c < NR; c++)
+					{
+						acc[r][c] = _mm256_fmadd_pd(a, b[c], acc[r][c]);
+					}
+				}
+			}
+
+			for (int r = 0; r < MR; r++)
+			{
+				for (int c = 0; c < NR; c++)
+				{
+					C[(size_t)r * ldc + c] += hsum(acc[r][c]);
+				}
+			}
+		}
+
+		// Rows of B and C are aligned
+		template <int MR, int NV>
+		BPNN_AVX2_TARGET static void NN(const double *A, int ars, int acs, const double *B, int ldb, double *C, int ldc, int k0, int k1, double alpha)
+		{
+			__m256d acc[MR][NV];
+			for (int r = 0; r < MR; r++)
+			{
+				for (int v = 0; v < NV; v++)
+				{
+					acc[r][v] = _mm256_setzero_pd();
+				}
+			}
+
+			for (int k = k0; k < k1; k++)
+			{
+				__m256d b[NV];
+				for (int v = 0; v < NV; v++)
+				{
+					b[v] = _mm256_load_pd(B + (size_t)k * ldb + v * BPNN_LANES);
+				}
+				for (int r = 0; r < MR; r++)
+				{
+					__m256d a = _mm256_set1_pd(A[(size_t)r * ars + (size_t)k * acs]);
+					for (int v = 0; v < NV; v++)
+					{
+						acc[r][v] = _mm256_fmadd_pd(a, b[v], acc[r][v]);
+					}
+				}
+			}
+
+			__m256d alpha_v = _mm256_set1_pd(alpha);
+			for (int r = 0; r < MR; r++)
+			{
+				for (int v = 0; v < NV; v++)
+				{
+					double *c = C + (size_t)r * ldc + v * BPNN_LANES;
+					_mm256_store_pd(c, _mm256_fmadd_pd(alpha_v, acc[r][v], _mm256_load_pd(c)));
+				}
+			}
+		}
+	};
+#endif
+
+	// C = A * B^T, A is M x K, B is N x K, C is M x N (K is a multiple of BPNN_LANES, rows of A and B are aligned)
+	template <typename Tiles>
+	static void gemmNTBlocked(const double *A, int lda, const double *B, int ldb, double *C, int ldc, int M, int N, int K)
+	{
+		for (int m = 0; m < M; m++)
+		{
+			memset(C + (size_t)m * ldc, 0, sizeof(double) * N);
+		}
+
+		for (int k0 = 0; k0 < K; k0 += BPNN_BLOCK_K)
+		{
+			int k1 = std::min(k0 + BPNN_BLOCK_K, K);
+			for (int n0 = 0; n0 < N; n0 += BPNN_BLOCK_N)
+			{
+				int n1 = std::min(n0 + BPNN_BLOCK_N, N);
+
+				// 4 x 3 register tiles, then the remaining columns and rows
+				int m = 0;
+				for (; m + 4 <= M; m += 4)
+				{
+					int n = n0;
+					for (; n + 3 <= n1; n += 3)
+					{
+						Tiles::template NT<4, 3>(A + (size_t)m * lda, lda, B + (size_t)n * ldb, ldb, C + (size_t)m * ldc + n, ldc, k0, k1);
+					}
+					for (; n < n1; n++)
+					{
+						Tiles::template NT<4, 1>(A + (size_t)m * lda, lda, B + (size_t)n * ldb, ldb, C + (size_t)m * ldc + n, ldc, k0, k1);
+					}
+				}
+				for (; m < M; m++)
+				{
+					int n = n0;
+					for (; n + 3 <= n1; n += 3)
+					{
+						Tiles::template NT<1, 3>(A + (size_t)m * lda, lda, B + (size_t)n * ldb, ldb, C + (size_t)m * ldc + n, ldc, k0, k1);
+					}
+					for (; n < n1; n++)
+					{
+						Tiles::template NT<1, 1>(A + (size_t)m * lda, lda, B + (size_t)n * ldb, ldb, C + (size_t)m * ldc + n, ldc, k0, k1);
+					}
+				}
+			}
+		}
+	}
+
+	// C += alpha * A * B, A(m, k) = A[m * ars + k * acs] is M x K (strides select A or A^T), B is K x N, C is M x N
+	// (N is a multiple of BPNN_LANES, rows of B and C are aligned)
+	template <typename Tiles>
+	static void gemmNNBlocked(const double *A, int ars, int acs, const double *B, int ldb, double *C, int ldc, int M, int N, int K, double alpha)
+	{
+		for (int k0 = 0; k0 < K; k0 += BPNN_BLOCK_K)
+		{
+			int k1 = std::min(k0 + BPNN_BLOCK_K, K);
+			for (int n0 = 0; n0 < N; n0 += BPNN_BLOCK_N)
+			{
+				int n1 = std::min(n0 + BPNN_BLOCK_N, N);
+
+				// 4 x 12 register tiles, then the remaining columns and rows
+				int m = 0;
+				for (; m + 4 <= M; m += 4)
+				{
+					int n = n0;
+					for (; n + 3 * BPNN_LANES <= n1; n += 3 * BPNN_LANES)
+					{
+						Tiles::template NN<4, 3>(A + (size_t)m * ars, ars, acs, B + n, ldb, C + (size_t)m * ldc + n, ldc, k0, k1, alpha);
+					}
+					for (; n < n1; n += BPNN_LANES)
+					{
+						Tiles::template NN<4, 1>(A + (size_t)m * ars, ars, acs, B + n, ldb, C + (size_t)m * ldc + n, ldc, k0, k1, alpha);
+					}
+				}
+				for (; m < M; m++)
+				{
+					int n = n0;
+					for (; n + 3 * BPNN_LANES <= n1; n += 3 * BPNN_LANES)
+					{
+						Tiles::template NN<1, 3>(A + (size_t)m * ars, ars, acs, B + n, ldb, C + (size_t)m * ldc + n, ldc, k0, k1, alpha);
+					}
+					for (; n < n1; n += BPNN_LANES)
+					{
+						Tiles::template NN<1, 1>(A + (size_t)m * ars, ars, acs, B + n, ldb, C + (size_t)m * ldc + n, ldc, k0, k1, alpha);
+					}
+				}
+			}
+		}
+	}
+
+	static void gemmNT(const double *A, int lda, const double *B, int ldb, double *C, int ldc, int M, int N, int K)
+	{
+#if defined(ANO_ENABLE_AVX2)
+		if (hasAVX2())
+		{
+			gemmNTBlocked<AVX2Tiles>(A, lda, B, ldb, C, ldc, M, N, K);
+			return;
+		}
+#endif
+		gemmNTBlocked<ScalarTiles>(A, lda, B, ldb, C, ldc, M, N, K);
+	}
+
+	static void gemmNN(const double *A, int ars, int acs, const double *B, int ldb, double *C, int ldc, int M, int N, int K, double alpha)
+	{
+#if defined(ANO_ENABLE_AVX2)
+		if (hasAVX2())
+		{
+			gemmNNBlocked<AVX2Tiles>(A, ars, acs, B, ldb, C, ldc, M, N, K, alpha);
+			return;
+		}
+#endif
+		gemmNNBlocked<ScalarTiles>(A, ars, acs, B, ldb, C, ldc, M, N, K, alpha);
+	}
+
 	NN *createNN(int n, int h, int o)
 	{
 		srand(time(NULL));
@@ -34,26 +437,27 @@ namespace ano::bpnn
 		nn->n[2] = o;
 		nn->l = 3;
 
-		nn->w = new double **[nn->l - 1];
+		nn->s = new int[nn->l];
+		for (int k = 0; k < nn->l; k++)
+		{
+			nn->s[k] = alignedLength(nn->n[k]);
+		}
+
+		nn->w = new double *[nn->l - 1];
 
 		for (int k = 0; k < nn->l - 1; k++)
 		{
-			nn->w[k] = new double *[nn->n[k + 1]];
+			nn->w[k] = allocVector(nn->n[k + 1] * nn->s[k]);
 			for (int j = 0; j < nn->n[k + 1]; j++)
 			{
-				nn->w[k][j] = new double[nn->n[k]];
-				randomize(nn->w[k][j], nn->n[k]);
-				// BIAS
-				// nn->w[k][j] = new double[nn->n[k] + 1];
-				// randomize( nn->w[k][j], nn->n[k] + 1 );
+				randomize(nn->w[k] + j * nn->s[k], nn->n[k]);
 			}
 		}
 
 		nn->y = new double *[nn->l];
 		for (int k = 0; k < nn->l; k++)
 		{
-			nn->y[k] = new double[nn->n[k]];
-			memset(nn->y[k], 0, sizeof(double) * nn->n[k]);
+			nn->y[k] = allocVector(nn->s[k]);
 		}
 
 		nn->in = nn->y[0];
@@ -62,10 +466,14 @@ namespace ano::bpnn
 		nn->d = new double *[nn->l];
 		for (int k = 0; k < nn->l; k++)
 		{
-			nn->d[k] = new double[nn->n[k]];
-			memset(nn->d[k], 0, sizeof(double) * nn->n[k]);
+			nn->d[k] = allocVector(nn->s[k]);
 		}
 
+		// Mini-batch matrices are allocated by the first batch call
+		nn->b = 0;
+		nn->by = new double *[nn->l]();
+		nn->bd = new double *[nn->l]();
+
 		return nn;
 	}
 
@@ -73,26 +481,31 @@ namespace ano::bpnn
 	{
 		for (int k = 0; k < nn->l - 1; k++)
 		{
-			for (int j = 0; j < nn->n[k + 1]; j++)
-			{
-				delete[] nn->w[k][j];
-			}
-			delete[] nn->w[k];
+			free(nn->w[k]);
 		}
 		delete[] nn->w;
 
 		for (int k = 0; k < nn->l; k++)
 		{
-			delete[] nn->y[k];
+			free(nn->y[k]);
 		}
 		delete[] nn->y;
 
 		for (int k = 0; k < nn->l; k++)
 		{
-			delete[] nn->d[k];
+			free(nn->d[k]);
 		}
 		delete[] nn->d;
 
+		for (int k = 0; k < nn->l; k++)
+		{
+			free(nn->by[k]);
+			free(nn->bd[k]);
+		}
+		delete[] nn->by;
+		delete[] nn->bd;
+
+		delete[] nn->s;
 		delete[] nn->n;
 
 		delete nn;
@@ -102,33 +515,22 @@ namespace ano::bpnn
 	void feedforward(NN *nn)
 	{
 		// k - layer index
-		// w[layer][to-layer+1][from-layer] - weights
+		// w[layer] - weights, row-major matrix n[layer+1] x s[layer] (row = neuron in next layer)
 		// y - outputs
 		// d - errors
-		// n - num of neurons in layers
-
-		auto in = nn->y[0];
+		// n - num of neurons in layers, s - padded row length
 
 		// Propagate through all layers. Start from second layer - inputs are given
 		for (int layer = 1; layer < nn->l; layer++)
 		{
-			auto layer_w = nn->w[layer - 1];
 			auto layer_y = nn->y[layer];
-			auto layer_y_prev = nn->y[layer - 1];
 			auto layer_n = nn->n[layer];
-			auto layer_n_prev = nn->n[layer - 1];
 
-			// For every neuron in current layer
+			// Sum up all inputs from previous layer for every neuron in current layer
+			gemv(nn->w[layer - 1], layer_n, nn->s[layer - 1], nn->y[layer - 1], layer_y);
+
 			for (int i = 0; i < layer_n; i++)
 			{
-				// Clear input
-				layer_y[i] = 0;
-
-				// Sum up all inputs from previous layer
-				for (int j = 0; j < layer_n_prev; j++)
-				{
-					layer_y[i] += layer_w[i][j] * layer_y_prev[j];
-				}
 				layer_y[i] = 1.0 / (1.0 + exp(-layer_y[i]));
 			}
 		}
@@ -147,60 +549,153 @@ namespace ano::bpnn
 		error /= 2;
 
 		// Calculate deltas for output layer
+		auto layer_d_out = nn->d[nn->l - 1];
 		for (int i = 0; i < n_out; i++)
 		{
-			auto layer_d = nn->d[nn->l - 1];
-			layer_d[i] = (t[i] - nn->out[i]) * nn->out[i] * (1 - nn->out[i]);
+			layer_d_out[i] = (t[i] - nn->out[i]) * nn->out[i] * (1 - nn->out[i]);
 		}
 
 		// Calculate other deltas
 		// For every layer except output layer
 		for (int layer = nn->l - 2; layer > 0; layer--)
 		{
-			auto layer_w_next = nn->w[layer]; // This time is layer not layer-1 as we are going backwards
 			auto layer_d = nn->d[layer];
-			auto layer_d_next = nn->d[layer + 1];
 			auto layer_y = nn->y[layer];
 			auto layer_n = nn->n[layer];
-			auto layer_n_next = nn->n[layer + 1];
 
-			// For every neuron in current layer
+			// Sum up deltas from next layer - w[layer] (not layer-1) as we are going backwards
+			gemvTransposed(nn->w[layer], nn->n[layer + 1], nn->s[layer], nn->d[layer + 1], layer_d);
+
 			for (int i = 0; i < layer_n; i++)
 			{
-				// Clear delta
-				layer_d[i] = 0;
+				layer_d[i] *= layer_y[i] * (1 - layer_y[i]);
+			}
+		}
 
-				// Sum up deltas from next layer
-				for (int j = 0; j < layer_n_next; j++)
+		// Update weights - go through all neurons in next layer and add Δd = d[layer+1][j] * y[layer] to their row
+		for (int layer = 0; layer < nn->l - 1; layer++)
+		{
+			ger(nn->w[layer], nn->n[layer + 1], nn->s[layer], nn->d[layer + 1], nn->y[layer]);
+		}
+
+		return error;
+	}
+
+	// Grows the mini-batch matrices of all layers to hold at least batch samples
+	void reserveBatch(NN *nn, int batch)
+	{
+		if (batch <= nn->b)
+		{
+			return;
+		}
+
+		for (int k = 0; k < nn->l; k++)
+		{
+			free(nn->by[k]);
+			nn->by[k] = allocVector(batch * nn->s[k]);
+		}
+
+		// Inputs have no deltas, bd[0] stays null
+		for (int k = 1; k < nn->l; k++)
+		{
+			free(nn->bd[k]);
+			nn->bd[k] = allocVector(batch * nn->s[k]);
+		}
+		nn->b = batch;
+	}
+
+	// Forward pass of batch samples (rows of in) into by
+	void feedforwardRows(NN *nn, const double *in, int batch)
+	{
+		reserveBatch(nn, batch);
+
+		// Padding of the rows stays zero
+		for (int b = 0; b < batch; b++)
+		{
+			memcpy(nn->by[0] + (size_t)b * nn->s[0], in + (size_t)b * nn->n[0], sizeof(double) * nn->n[0]);
+		}
+
+		for (int layer = 1; layer < nn->l; layer++)
+		{
+			auto layer_y = nn->by[layer];
+			auto layer_n = nn->n[layer];
+			auto layer_s = nn->s[layer];
+
+			// Y[layer] = Y[layer-1] * W[layer-1]^T
+			gemmNT(nn->by[layer - 1], nn->s[layer - 1], nn->w[layer - 1], nn->s[layer - 1], layer_y, layer_s, batch, layer_n, nn->s[layer - 1]);
+
+			for (int b = 0; b < batch; b++)
+			{
+				auto row_y = layer_y + (size_t)b * layer_s;
+				for (int i = 0; i < layer_n; i++)
 				{
-					layer_d[i] += layer_d_next[j] * layer_w_next[j][i]; // w[layer][j][konst] - iterate through all neurons in next layer
+					row_y[i] = 1.0 / (1.0 + exp(-row_y[i]));
 				}
+			}
+		}
+	}
 
-				layer_d[i] *= layer_y[i] * (1 - layer_y[i]);
+	void feedforwardBatch(NN *nn, const double *in, int batch, double *out)
+	{
+		feedforwardRows(nn, in, batch);
+
+		auto n_out = nn->n[nn->l - 1];
+		auto s_out = nn->s[nn->l - 1];
+		for (int b = 0; b < batch; b++)
+		{
+			memcpy(out + (size_t)b * n_out, nn->by[nn->l - 1] + (size_t)b * s_out, sizeof(double) * n_out);
+		}
+	}
+
+	double trainBatch(NN *nn, const double *in, const double *t, int batch, double eta)
+	{
+		feedforwardRows(nn, in, batch);
+
+		// Calculate error and deltas for output layer
+		double error = 0.0;
+		auto n_out = nn->n[nn->l - 1];
+		auto s_out = nn->s[nn->l - 1];
+		for (int b = 0; b < batch; b++)
+		{
+			auto row_out = nn->by[nn->l - 1] + (size_t)b * s_out;
+			auto row_d = nn->bd[nn->l - 1] + (size_t)b * s_out;
+			auto row_t = t + (size_t)b * n_out;
+			for (int i = 0; i < n_out; i++)
+			{
+				error += SQR(row_out[i] - row_t[i]);
+				row_d[i] = (row_t[i] - row_out[i]) * row_out[i] * (1 - row_out[i]);
 			}
 		}
+		error /= 2 * batch;
 
-		// Update weights
-		for (int layer = 0; layer < nn->l; layer++)
+		// Calculate other deltas, D[layer] = D[layer+1] * W[layer]
+		for (int layer = nn->l - 2; layer > 0; layer--)
 		{
-			auto layer_w = nn->w[layer];
-			auto layer_d_next = nn->d[layer + 1];
-			auto layer_y = nn->y[layer];
+			auto layer_d = nn->bd[layer];
+			auto layer_y = nn->by[layer];
 			auto layer_n = nn->n[layer];
-			auto layer_n_next = nn->n[layer + 1];
+			auto layer_s = nn->s[layer];
 
-			// Go through all weights in current layer
-			for (int i = 0; i < layer_n; i++)
+			memset(layer_d, 0, sizeof(double) * batch * layer_s);
+			gemmNN(nn->bd[layer + 1], nn->s[layer + 1], 1, nn->w[layer], layer_s, layer_d, layer_s, batch, layer_s, nn->n[layer + 1], 1.0);
+
+			for (int b = 0; b < batch; b++)
 			{
-				// Go through all neurons in next layer and calculate Δd and add it to weight
-				for (int j = 0; j < layer_n_next; j++)
+				auto row_d = layer_d + (size_t)b * layer_s;
+				auto row_y = layer_y + (size_t)b * layer_s;
+				for (int i = 0; i < layer_n; i++)
 				{
-					auto weight_delta = layer_d_next[j] * layer_y[i];
-					layer_w[j][i] += weight_delta;
+					row_d[i] *= row_y[i] * (1 - row_y[i]);
 				}
 			}
 		}
 
+		// One update per batch with the mean of the per-sample updates, W[layer] += eta / batch * D[layer+1]^T * Y[layer]
+		for (int layer = 0; layer < nn->l - 1; layer++)
+		{
+			gemmNN(nn->bd[layer + 1], 1, nn->s[layer + 1], nn->by[layer], nn->s[layer], nn->w[layer], nn->s[layer], nn->n[layer + 1], nn->s[layer], batch, eta / batch);
+		}
+
 		return error;
 	}
 
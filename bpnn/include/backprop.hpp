@@ -6,14 +6,19 @@ namespace ano::bpnn
 	struct NN
 	{
 		int *n;		 // pocty neuronu
+		int *s;		 // delky radku vrstev (n zaokrouhlene na nasobek 4)
 		int l;		 // pocet vrstev
-		double ***w; // vahy
+		double **w; // vahy, w[k] je souvisla matice n[k+1] x s[k] (radek = neuron)
 
 		double *in;	 // vstupni vektor
 		double *out; // vystupni vektor
 		double **y;	 // vystupni vektory vrstev
 
 		double **d; // chyby neuronu
+
+		int b;		 // kapacita davky (pocet vzorku)
+		double **by; // vystupy vrstev pro davku, by[k] je matice b x s[k]
+		double **bd; // chyby neuronu pro davku, bd[k] je matice b x s[k] pro k >= 1 (bd[0] = NULL)
 	};
 
 	NN *createNN(int n, int h, int o);
@@ -23,4 +28,9 @@ namespace ano::bpnn
 	void setInput(NN *nn, double *in, bool verbose = false);
 	int getOutput(NN *nn, bool verbose = false);
 
+	// Mini-batch variants, in is a row-major batch x n[0] matrix, t and out are batch x n[l-1].
+	// trainBatch applies one weight update per batch (eta times the mean update of its samples) and returns the mean error.
+	void feedforwardBatch(NN *nn, const double *in, int batch, double *out);
+	double trainBatch(NN *nn, const double *in, const double *t, int batch, double eta = 1.0);
+
 }
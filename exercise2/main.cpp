@@ -4,6 +4,7 @@
 #include <opencv2/opencv.hpp>
 
 #include "text.hpp"
+#include "threshold.hpp"
 #include "floodfill.hpp"
 #include "color-generator.hpp"
 #include "moments.hpp"
@@ -41,14 +42,8 @@ int main(int argc, char **argv)
     /* ============== THRESHOLDING ============== */
     unsigned char threshold = 50;
 
-    cv::Mat image_threshold(image_in.size(), CV_8UC1);
-    for (int y = 0; y < image_threshold.size[0]; y++)
-    {
-        for (int x = 0; x < image_threshold.size[1]; x++)
-        {
-            image_threshold.at<unsigned char>(y, x) = (image_in.at<unsigned char>(y, x) > threshold) ? 255 : 0;
-        }
-    }
+    cv::Mat image_threshold;
+    ano::Threshold(image_in, image_threshold, threshold);
     cv::namedWindow("Thresholding", cv::WINDOW_AUTOSIZE);
     cv::imshow("Thresholding", image_threshold);
     /* ============== THRESHOLDING ============== */
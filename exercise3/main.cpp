@@ -5,36 +5,37 @@
 #include <opencv2/opencv.hpp>
 
 #include "text.hpp"
+#include "threshold.hpp"
 #include "floodfill.hpp"
 #include "color-generator.hpp"
 #include "moments.hpp"
 #include "detected-object.hpp"
 #include "ethalons.hpp"
+#include "detection-pipeline.hpp"
 
 #define TRAIN_IMG_PATH "../../img/train.png"
 #define TRAIN_IMG_NAME "Training_image"
 #define TEST_IMG_PATH "../../img/test02.png"
 #define TEST_IMG_NAME "Test_image"
 
+// Object labels are assigned in raster order of the objects' first pixel
 unsigned char id_map[][2] = {
-    {243, 1}, {244, 1}, {245, 1}, {246, 1}, //
-    {247, 2},
-    {248, 2},
-    {249, 2},
-    {250, 2}, //
-    {251, 3},
-    {252, 3},
-    {253, 3},
-    {254, 3}, //
+    {12, 1}, {11, 1}, {10, 1}, {9, 1}, //
+    {8, 2},
+    {7, 2},
+    {6, 2},
+    {5, 2}, //
+    {4, 3},
+    {3, 3},
+    {2, 3},
+    {1, 3}, //
 };
 
-void Threshold(const cv::Mat &image_in, cv::Mat &image_threshold, unsigned char threshold);
-// Flood fill threshold image and save colored result in image_indexing. Also save info about detected objects (id, x, y) in detected_objects.
-// object_index - starting id for indexing. Decrements for each new object.
+// Save colored labels of the processed frame in image_indexing. Also copy the detected objects (id, x, y, features) of the frame to detected_objects.
 // assign_class_from_map - used to assign class from id_map for training ethalons from training images.
-void Indexing(cv::Mat &image_threshold, cv::Mat &image_indexing, ano::DetectedObjectsVector &detected_objects, unsigned char &object_index, const cv::Vec3b &color_for_mixing, bool assign_class_from_map = false);
-// Calculate moments of all detected objects starting from id == object_index up to id == 254 (including 254)
-void Moments(const cv::Mat &image_threshold, ano::DetectedObjectsVector &detected_objects, unsigned char object_index);
+void Indexing(const ano::DetectionFrame &frame, cv::Mat &image_indexing, ano::DetectedObjectsVector &detected_objects, const cv::Vec3b &color_for_mixing, bool assign_class_from_map = false);
+// Print moments of all detected objects
+void Moments(const ano::DetectedObjectsVector &detected_objects);
 // Load image from file.
 std::optional<cv::Mat> LoadImage(const cv::String &filename, const cv::String &window_name = "", bool show_img = true, int flags = 1);
 // Calculate and draw class ethalons
@@ -63,47 +64,40 @@ int main(int argc, char **argv)
     /* ============== THRESHOLDING ============== */
     unsigned char threshold = 50;
 
-    // Threshold training image.
-    cv::Mat image_threshold_train(image_in.size(), CV_8UC1);
-    Threshold(image_in, image_threshold_train, threshold);
-
-    // Threshold test image.
-    cv::Mat image_threshold_test(image_test.size(), CV_8UC1);
-    Threshold(image_test, image_threshold_test, threshold);
+    // Thresholding -> Indexing -> Moments of both images. The thresholding is not fused into the indexing to show the threshold images.
+    // The pipeline reuses its buffers for every processed image.
+    ano::DetectionPipeline pipeline(threshold, false);
     /* ============== THRESHOLDING ============== */
 
     /* ============== Indexing ============== */
-    cv::Mat image_indexing_train = cv::Mat(image_threshold_train.size(), CV_8UC3, cv::Scalar(0, 0, 0));
-    cv::Mat image_indexing_test = cv::Mat(image_threshold_test.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+    cv::Mat image_indexing_train;
+    cv::Mat image_indexing_test;
 
     ano::DetectedObjectsVector detected_objects_train;
     ano::DetectedObjectsVector detected_objects_test;
 
     // Train
-    // Starting id
-    unsigned char object_index_train = -2; // char max - 1 (as 255 is reserved for foreground)
-    Indexing(image_threshold_train, image_indexing_train, detected_objects_train, object_index_train, {255, 255, 255}, true);
+    pipeline.Process(image_in);
+    Indexing(pipeline.Frame(), image_indexing_train, detected_objects_train, {255, 255, 255}, true);
 
     cv::namedWindow("Indexing train", cv::WINDOW_NORMAL || cv::WINDOW_KEEPRATIO);
     cv::imshow("Indexing train", image_indexing_train);
 
     cv::namedWindow("Thresholding train", cv::WINDOW_AUTOSIZE);
-    cv::imshow("Thresholding train", image_threshold_train);
+    cv::imshow("Thresholding train", pipeline.Frame().image_threshold);
 
     // Test
-    // Starting id
-    unsigned char object_index_test = -2; // char max - 1 (as 255 is reserved for foreground)
+    pipeline.Process(image_test);
     // Do not assign class from id_map
-    Indexing(image_threshold_test, image_indexing_test, detected_objects_test, object_index_test, {255, 255, 255}, false);
+    Indexing(pipeline.Frame(), image_indexing_test, detected_objects_test, {255, 255, 255}, false);
 
     cv::namedWindow("Thresholding test", cv::WINDOW_AUTOSIZE);
-    cv::imshow("Thresholding test", image_threshold_test);
+    cv::imshow("Thresholding test", pipeline.Frame().image_threshold);
     /* ============== Indexing ============== */
 
     /* ============== Moments ============== */
-    // Iterate through all indexed objects
-    Moments(image_threshold_train, detected_objects_train, object_index_train + 1);
-    Moments(image_threshold_test, detected_objects_test, object_index_test + 1);
+    Moments(detected_objects_train);
+    Moments(detected_objects_test);
     /* ============== Moments ============== */
 
     /* ============== Ethalons ============== */
@@ -111,7 +105,7 @@ int main(int argc, char **argv)
 
     float f1_scale = 1.f;
     float f2_scale = 0.5f;
-    auto image_ethalons = cv::Mat(image_threshold_train.size(), CV_8UC3);
+    auto image_ethalons = cv::Mat(image_in.size(), CV_8UC3);
 
     ClassEthalons(image_ethalons, detected_objects_train, ethalons, f1_scale, f2_scale);
 
@@ -163,98 +157,52 @@ std::optional<cv::Mat> LoadImage(const cv::String &filename, const cv::String &w
     return image_in;
 }
 
-void Threshold(const cv::Mat &image_in, cv::Mat &image_threshold, unsigned char threshold)
+void Indexing(const ano::DetectionFrame &frame, cv::Mat &image_indexing, ano::DetectedObjectsVector &detected_objects, const cv::Vec3b &color_for_mixing, bool assign_class_from_map)
 {
-    for (int y = 0; y < image_threshold.size[0]; y++)
+    // Fill every object with random color
+    ano::ColorizeLabels(frame.image_labels, image_indexing, static_cast<int>(frame.components.size()), color_for_mixing);
+
+    // Save the detected objects
+    detected_objects = frame.objects;
+
+    for (auto &detected : detected_objects)
     {
-        for (int x = 0; x < image_threshold.size[1]; x++)
+        // Get the class label
+        auto obj_id_it = std::find_if(std::begin(id_map), std::end(id_map), [&detected](const auto &map_pair)
+                                      { return map_pair[0] == detected.id_pixel; });
+
+        // Skip the class assignment if it is not required
+        if (!assign_class_from_map)
         {
-            image_threshold.at<unsigned char>(y, x) = (image_in.at<unsigned char>(y, x) > threshold) ? 255 : 0;
+            obj_id_it = std::end(id_map);
         }
-    }
-}
 
-void Indexing(cv::Mat &image_threshold, cv::Mat &image_indexing, ano::DetectedObjectsVector &detected_objects, unsigned char &object_index, const cv::Vec3b &color_for_mixing, bool assign_class_from_map)
-{
-    for (int y = 0; y < image_threshold.size[0]; y++)
-    {
-        for (int x = 0; x < image_threshold.size[1]; x++)
+        if (obj_id_it != std::end(id_map))
         {
-            if (image_threshold.at<unsigned char>(y, x) == 255)
-            {
-                // Fill with random color
-                auto color = ano::GenerateRandomColorBGR(color_for_mixing);
-                ano::FloodFillInPlace(image_threshold, image_indexing, x, y, color, object_index);
-
-                // Get the class label
-                auto obj_id_it = std::find_if(std::begin(id_map), std::end(id_map), [&object_index](const auto &map_pair)
-                                              { return map_pair[0] == object_index; });
-
-                // Skip the class assignment if it is not required
-                if (!assign_class_from_map)
-                {
-                    obj_id_it = std::end(id_map);
-                }
-
-                unsigned char obj_id = 0;
-                if (obj_id_it != std::end(id_map))
-                {
-                    obj_id = (*obj_id_it)[1];
-                }
-
-                // Save the detected object
-                detected_objects.emplace_back(object_index, obj_id, x, y);
-
-                // Output info to the image
-                cv::putText(image_indexing, "ID: " + std::to_string(object_index), cv::Point(x, y), TEXT_FONT, TEXT_SIZE, TEXT_COLOR, 1);
-                if (obj_id != 0)
-                {
-                    cv::putText(image_indexing, "Class: " + std::to_string(obj_id), cv::Point(x, y + TEXT_LINE_HEIGHT), TEXT_FONT, TEXT_SIZE, TEXT_COLOR, 1);
-                }
-
-                // Decrement id
-                object_index--;
-            }
+            detected.id_class = (*obj_id_it)[1];
+        }
+
+        // Output info to the image
+        cv::putText(image_indexing, "ID: " + std::to_string(detected.id_pixel), cv::Point(detected.x, detected.y), TEXT_FONT, TEXT_SIZE, TEXT_COLOR, 1);
+        if (detected.id_class != 0)
+        {
+            cv::putText(image_indexing, "Class: " + std::to_string(detected.id_class), cv::Point(detected.x, detected.y + TEXT_LINE_HEIGHT), TEXT_FONT, TEXT_SIZE, TEXT_COLOR, 1);
         }
     }
 }
 
-void Moments(const cv::Mat &image_threshold, ano::DetectedObjectsVector &detected_objects, unsigned char object_index)
+void Moments(const ano::DetectedObjectsVector &detected_objects)
 {
-    for (unsigned char obj_index = object_index; obj_index < 255; obj_index++)
+    for (const auto &detected : detected_objects)
     {
+        const auto &obj_features = detected.features;
 
-        auto center_of_mass = ano::CenterOfMass(image_threshold, obj_index);
-        float area = ano::Area(image_threshold, obj_index);
-        auto F1 = std::pow(ano::Circumference(image_threshold, obj_index), 2) / (100 * area);
-
-        auto u20 = ano::CenteredMoment(image_threshold, 2, 0, obj_index);
-        auto u02 = ano::CenteredMoment(image_threshold, 0, 2, obj_index);
-        auto u11 = ano::CenteredMoment(image_threshold, 1, 1, obj_index);
-        float umax = 0.5f * (u20 + u02) + 0.5f * std::sqrt(4 * std::pow(u11, 2) + std::pow(u20 - u02, 2));
-        float umin = 0.5f * (u20 + u02) - 0.5f * std::sqrt(4 * std::pow(u11, 2) + std::pow(u20 - u02, 2));
-        auto F2 = umin / umax;
-
-        std::cout << "Object index: " << std::to_string(obj_index) << "\n"
-                  << "\tCenter of mass: " << center_of_mass << "\n"
-                  << "\tArea: " << area << "\n"
-                  << "\tF1: " << F1 << "\n"
-                  << "\tF2: " << F2 << "\n\n"
+        std::cout << "Object index: " << std::to_string(detected.id_pixel) << "\n"
+                  << "\tCenter of mass: " << obj_features.center_of_mass << "\n"
+                  << "\tArea: " << obj_features.area << "\n"
+                  << "\tF1: " << obj_features.F1 << "\n"
+                  << "\tF2: " << obj_features.F2 << "\n\n"
                   << std::endl;
-
-        auto obj_it = ano::DetectedObjectsVectorGetByPixelID(detected_objects, obj_index);
-        if (obj_it == detected_objects.end())
-        {
-            std::cout << "Object not found" << std::endl;
-        }
-        else
-        {
-            auto &obj_features = obj_it->features;
-            obj_features.center_of_mass = center_of_mass;
-            obj_features.area = area;
-            obj_features.F1 = F1;
-            obj_features.F2 = F2;
-        }
     }
 }
 
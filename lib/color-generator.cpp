@@ -1,6 +1,8 @@
 #include "color-generator.hpp"
 
+#include <cassert>
 #include <random>
+#include <vector>
 
 const static int range_from = 0;
 const static int range_to = 255;
@@ -26,4 +28,27 @@ namespace ano
         return cv::Vec3b(blue, green, red);
     }
 
+    void ColorizeLabels(const cv::Mat &img_labels, cv::Mat &img_out, int label_count, const cv::Vec3b &color_base)
+    {
+        assert(img_labels.type() == CV_32SC1);
+
+        std::vector<cv::Vec3b> colors(label_count + 1);
+        colors[0] = cv::Vec3b(0, 0, 0);
+        for (int i = 1; i <= label_count; i++)
+        {
+            colors[i] = GenerateRandomColorBGR(color_base);
+        }
+
+        img_out.create(img_labels.size(), CV_8UC3);
+        for (int y = 0; y < img_labels.size[0]; y++)
+        {
+            const int *row_labels = img_labels.ptr<int>(y);
+            cv::Vec3b *row_out = img_out.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < img_labels.size[1]; x++)
+            {
+                row_out[x] = colors[row_labels[x]];
+            }
+        }
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "detection-pipeline.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "threshold.hpp"
+
+namespace ano
+{
+    DetectionPipeline::DetectionPipeline(unsigned char threshold, bool fuse_threshold, int strip_count)
+        : threshold(threshold), fuse_threshold(fuse_threshold), strip_count(strip_count)
+    {
+    }
+
+    void DetectionPipeline::SetEthalons(const Ethalons &ethalons)
+    {
+        this->ethalons = ethalons;
+        has_ethalons = true;
+    }
+
+    const DetectedObjectsVector &DetectionPipeline::Process(const cv::Mat &image)
+    {
+        frame.image = image;
+
+        Threshold(frame);
+        Label(frame);
+        ExtractFeatures(frame);
+        Classify(frame);
+
+        return frame.objects;
+    }
+
+    void DetectionPipeline::Threshold(DetectionFrame &frame) const
+    {
+        assert(frame.image.type() == CV_8UC1);
+
+        if (fuse_threshold)
+        {
+            return;
+        }
+
+        ano::Threshold(frame.image, frame.image_threshold, threshold);
+    }
+
+    void DetectionPipeline::Label(DetectionFrame &frame) const
+    {
+        if (fuse_threshold)
+        {
+            LabelConnectedComponentsThreshold(frame.image, frame.image_labels, frame.components, threshold, strip_count);
+        }
+        else if (strip_count == 1)
+        {
+            LabelConnectedComponents(frame.image_threshold, frame.image_labels, frame.components);
+        }
+        else
+        {
+            LabelConnectedComponentsParallel(frame.image_threshold, frame.image_labels, frame.components, 255, strip_count);
+        }
+    }
+
+    void DetectionPipeline::ExtractFeatures(DetectionFrame &frame) const
+    {
+        const int count = static_cast<int>(frame.components.size());
+        ComputeMomentFeatures<int>(frame.image_labels, 1, count, frame.moments);
+
+        // clear() keeps the capacity, so the objects are constructed in place without allocating
+        frame.objects.clear();
+        for (const auto &component : frame.components)
+        {
+            const auto &moments = frame.moments[component.label];
+            DetectedObjectFeatures features(moments.CenterOfMass(), static_cast<float>(moments.Area()), moments.F1(), moments.F2());
+
+            frame.objects.emplace_back(component.label, 0, component.seed.x, component.seed.y,
+                                       component.bounding_box.width, component.bounding_box.height, features);
+        }
+    }
+
+    void DetectionPipeline::Classify(DetectionFrame &frame) const
+    {
+        if (!has_ethalons)
+        {
+            return;
+        }
+
+        for (auto &object : frame.objects)
+        {
+            const float values[] = {object.features.F1, object.features.F2};
+            object.id_class = ethalons.FindClosestClass(values);
+        }
+    }
+
+    StreamingDetectionPipeline::StreamingDetectionPipeline(const DetectionPipeline &stages, int slot_count)
+        : stages(stages), slots(std::max(slot_count, 1))
+    {
+        // Every queue can hold all slots and the end of stream marker, so the stages never wait for space downstream
+        for (auto &queue : queues)
+        {
+            queue = std::make_unique<SPSCQueue<int>>(slots.size() + 1);
+        }
+        for (int i = 0; i < static_cast<int>(slots.size()); i++)
+        {
+            queues[0]->TryPush(i);
+        }
+
+        threads.reserve(stage_count);
+        for (int stage = 0; stage < stage_count; stage++)
+        {
+            threads.emplace_back(&StreamingDetectionPipeline::RunStage, this, stage);
+        }
+    }
+
+    StreamingDetectionPipeline::~StreamingDetectionPipeline()
+    {
+        Close();
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    bool StreamingDetectionPipeline::Push(const cv::Mat &image)
+    {
+        assert(image.type() == CV_8UC1);
+
+        if (closed.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        int slot;
+        queues[0]->Pop(slot);
+
+        // Reuses the slot's buffer when the size matches
+        image.copyTo(slots[slot].image);
+
+        const bool pushed = queues[1]->TryPush(slot);
+        assert(pushed);
+        (void)pushed;
+        return true;
+    }
+
+    void StreamingDetectionPipeline::Close()
+    {
+        if (closed.exchange(true, std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        // The marker is queued behind the last pushed frame and passed on by every stage after all frames before it
+        const bool pushed = queues[1]->TryPush(end_of_stream);
+        assert(pushed);
+        (void)pushed;
+    }
+
+    const DetectionFrame *StreamingDetectionPipeline::Pop()
+    {
+        if (drained)
+        {
+            return nullptr;
+        }
+
+        int slot;
+        queues[stage_count + 1]->Pop(slot);
+        if (slot == end_of_stream)
+        {
+            drained = true;
+            return nullptr;
+        }
+        return &slots[slot];
+    }
+
+    void StreamingDetectionPipeline::Release(const DetectionFrame *frame)
+    {
+        const int slot = static_cast<int>(frame - slots.data());
+        assert(slot >= 0 && slot < static_cast<int>(slots.size()));
+
+        const bool pushed = queues[0]->TryPush(slot);
+        assert(pushed);
+        (void)pushed;
+    }
+
+    void StreamingDetectionPipeline::RunStage(int stage)
+    {
+        static constexpr void (DetectionPipeline::*functions[stage_count])(DetectionFrame &) const = {
+            &DetectionPipeline::Threshold,
+            &DetectionPipeline::Label,
+            &DetectionPipeline::ExtractFeatures,
+            &DetectionPipeline::Classify,
+        };
+
+        auto &input = *queues[stage + 1];
+        auto &output = *queues[stage + 2];
+
+        // Sleeps in Pop while the stream is idle
+        int slot;
+        do
+        {
+            input.Pop(slot);
+            if (slot != end_of_stream)
+            {
+                (stages.*functions[stage])(slots[slot]);
+            }
+
+            const bool pushed = output.TryPush(slot);
+            assert(pushed);
+            (void)pushed;
+        } while (slot != end_of_stream);
+    }
+}
\ No newline at end of file
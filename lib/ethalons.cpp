@@ -1,5 +1,7 @@
 #include "ethalons.hpp"
 
+#include <cassert>
+
 #include <opencv2/opencv.hpp>
 
 #include "text.hpp"
@@ -107,7 +109,12 @@ namespace ano
         return std::get<2>(*it);
     }
 
-    unsigned char Ethalons::FindClosestClass(const std::vector<float> &ethalons)
+    unsigned char Ethalons::FindClosestClass(const std::vector<float> &ethalons) const
+    {
+        return FindClosestClass(std::span<const float>(ethalons));
+    }
+
+    unsigned char Ethalons::FindClosestClass(std::span<const float> ethalons) const
     {
         unsigned char closest_class = 0;
         float closest_distance = std::numeric_limits<float>::max();
@@ -120,7 +127,8 @@ namespace ano
             int i = 0;
             for (; i < std::get<1>(ethalon).size(); i++)
             {
-                distance += std::pow(ethalons.at(i) - std::get<1>(ethalon).at(i), 2);
+                assert(i < static_cast<int>(ethalons.size()));
+                distance += std::pow(ethalons[i] - std::get<1>(ethalon).at(i), 2);
             }
 
             // Calculate euclidian distance
@@ -1,6 +1,7 @@
 #include <iostream>
-#include <tuple>
-#include <queue>
+#include <vector>
+#include <numeric>
+#include <atomic>
 
 #include "include/floodfill.hpp"
 
@@ -17,89 +18,108 @@ namespace ano
     // combined-scan-and-fill span filler
     template <typename T>
     void FloodFillInPlace(cv::Mat &img, cv::Mat &img_out, int starting_x, int starting_y, const T &color, const unsigned char index)
+    {
+        // Span stack reused by all fills on this thread -> no allocations once it has grown to the largest blob
+        thread_local FloodFillSpanStack stack;
+        FloodFillInPlace(img, img_out, starting_x, starting_y, color, index, stack);
+    }
+
+    // combined-scan-and-fill span filler
+    template <typename T>
+    void FloodFillInPlace(cv::Mat &img, cv::Mat &img_out, int starting_x, int starting_y, const T &color, const unsigned char index, FloodFillSpanStack &stack)
     {
         auto xmax = img.size[1];
-        decltype(xmax) xmin = 0;
         auto ymax = img.size[0];
-        decltype(ymax) ymin = 0;
 
-        // Similar to: https://en.wikipedia.org/wiki/Flood_fill#:~:text=The%20final%2C%20combined%2Dscan%2Dand%2Dfill%20span%20filler%20was%20then%20published%20in%201990.%20In%20pseudo%2Dcode%20form
-        if (img.at<unsigned char>(starting_y, starting_x) != 255)
+        assert(img.type() == CV_8UC1);
+        assert(img_out.size() == img.size());
+        assert(index != 255); // Filled pixels must stop being foreground
+
+        if (starting_x < 0 || starting_x >= xmax || starting_y < 0 || starting_y >= ymax)
         {
-            std::cout << "FloodFill at [x,y]: [" << starting_x << ", " << starting_y << "] failed: Starting point on the background." << std::endl;
+            std::cout << "FloodFill at [x,y]: [" << starting_x << ", " << starting_y << "] failed: Starting point outside of image." << std::endl;
             return;
         }
 
-        if (starting_x < 0 || starting_x > xmax || starting_y < 0 || starting_y > ymax)
+        // Similar to: https://en.wikipedia.org/wiki/Flood_fill#:~:text=The%20final%2C%20combined%2Dscan%2Dand%2Dfill%20span%20filler%20was%20then%20published%20in%201990.%20In%20pseudo%2Dcode%20form
+        if (img.ptr<unsigned char>(starting_y)[starting_x] != 255)
         {
-            std::cout << "FloodFill at [x,y]: [" << starting_x << ", " << starting_y << "] failed: Starting point outside of image." << std::endl;
+            std::cout << "FloodFill at [x,y]: [" << starting_x << ", " << starting_y << "] failed: Starting point on the background." << std::endl;
             return;
         }
 
-        // tuple of (xl,xr,y,dy) - left end of line, right end of line, y, direction: 1 = down, -1 = up (opencv has reversed y axis)
-        using ff_tuple = std::tuple<int, int, int, int>;
-
-        std::queue<ff_tuple> queue;
-        queue.push(std::move(ff_tuple(starting_x, starting_x, starting_y, 1)));
-        queue.push(std::move(ff_tuple(starting_x, starting_x, starting_y - 1, -1)));
+        // Spans of (xl,xr,y,dy) - left end of line, right end of line, y, direction: 1 = down, -1 = up (opencv has reversed y axis)
+        stack.clear();
+        stack.push_back({starting_x, starting_x, starting_y, 1});
+        stack.push_back({starting_x, starting_x, starting_y - 1, -1});
 
-        while (!queue.empty())
+        while (!stack.empty())
         {
-            auto [xl, xr, y, dy] = queue.front();
-            queue.pop();
-
-            auto x = xl;
+            auto [xl, xr, y, dy] = stack.back();
+            stack.pop_back();
 
-            // Find the first pixel in the given line segment from queue
-            while (x < xr && !(img.at<unsigned char>(y, x) == 255))
+            // Span above the top or below the bottom edge
+            if (y < 0 || y >= ymax)
             {
-                x++;
+                continue;
             }
 
+            unsigned char *row = img.ptr<unsigned char>(y);
+            T *row_out = img_out.ptr<T>(y);
+
+            // Pixel inside of the image and not filled yet
+            auto inside = [row, xmax](int x)
+            { return x >= 0 && x < xmax && row[x] == 255; };
+
+            auto x = xl;
+
             // Find the left edge
-            while (img.at<unsigned char>(y, x - 1) == 255)
+            if (inside(x))
             {
-                img.at<unsigned char>(y, x - 1) = index;
-                img_out.at<T>(y, x - 1) = color;
-                x--;
-            }
+                while (inside(x - 1))
+                {
+                    row[x - 1] = index;
+                    row_out[x - 1] = color;
+                    x--;
+                }
 
-            // If expanded to the left -> add segment from left edge (x) to left side of checked segment (xl) in -dy
-            if (x < xl)
-            {
-                queue.emplace(x, xl - 1, y - dy, -dy);
+                // If expanded to the left -> add segment from left edge (x) to left side of checked segment (xl) in -dy
+                if (x < xl)
+                {
+                    stack.push_back({x, xl - 1, y - dy, -dy});
+                }
             }
 
             // x is now the the new left edge
-            // Search between given line segment from queue
+            // Search between given line segment from stack
             while (xl <= xr)
             {
                 // Search the right edge for new segment
-                while (img.at<unsigned char>(y, xl) == 255)
+                while (inside(xl))
                 {
-                    img.at<unsigned char>(y, xl) = index;
-                    img_out.at<T>(y, xl) = color;
+                    row[xl] = index;
+                    row_out[xl] = color;
                     xl++;
                 }
 
-                // Found at least one pixel on the starting left edge -> add line segment to queue
+                // Found at least one pixel on the starting left edge -> add line segment to stack
                 if (xl > x)
                 {
                     // x is left edge, xl is one pixel to the right
-                    queue.emplace(x, xl - 1, y + dy, dy);
+                    stack.push_back({x, xl - 1, y + dy, dy});
                 }
 
                 // Expanded to the right -> add segment from right edge (xr) to right side of checked segment
                 if (xl - 1 > xr)
                 {
-                    queue.emplace(xr + 1, xl - 1, y - dy, -dy);
+                    stack.push_back({xr + 1, xl - 1, y - dy, -dy});
                 }
 
                 // The first while ended on background -> can add +1 as "speedup"
                 xl++;
 
-                // Find next segment above given line segment from queue
-                while (xl < xr && !(img.at<unsigned char>(y, xl) == 255))
+                // Find next segment above given line segment from stack
+                while (xl < xr && !inside(xl))
                 {
                     xl++;
                 }
@@ -111,19 +131,21 @@ namespace ano
     }
 
     template <typename T>
-    inline cv::Mat FloodFill(cv::Mat &img, const cv::Point &starting_pixel, const T &color, const unsigned char index)
+    cv::Mat FloodFill(cv::Mat &img, const cv::Point &starting_pixel, const T &color, const unsigned char index)
     {
         return FloodFill(img, starting_pixel.x, starting_pixel.y, color, index);
     }
 
     template <typename T>
-    inline cv::Mat FloodFill(cv::Mat &img, int starting_x, int starting_y, const T &color, const unsigned char index)
+    cv::Mat FloodFill(cv::Mat &img, int starting_x, int starting_y, const T &color, const unsigned char index)
     {
-        cv::Mat img_out(img.size(), CV_8UC3);
+        cv::Mat img_out(img.size(), cv::traits::Type<T>::value, cv::Scalar(0));
         FloodFillInPlace(img, img_out, starting_x, starting_y, color, index);
         return img_out;
     }
 
+    template void FloodFillInPlace<unsigned char>(cv::Mat &, cv::Mat &, int, int, const unsigned char &, const unsigned char, FloodFillSpanStack &);
+    template void FloodFillInPlace<cv::Vec3b>(cv::Mat &, cv::Mat &, int, int, const cv::Vec3b &, const unsigned char, FloodFillSpanStack &);
     template void FloodFillInPlace<unsigned char>(cv::Mat &, cv::Mat &, int, int, const unsigned char &, const unsigned char);
     template void FloodFillInPlace<cv::Vec3b>(cv::Mat &, cv::Mat &, int, int, const cv::Vec3b &, const unsigned char);
     template void FloodFillInPlace<unsigned char>(cv::Mat &, cv::Mat &, const cv::Point &, const unsigned char &, const unsigned char);
@@ -133,4 +155,361 @@ namespace ano
     template cv::Mat FloodFill<unsigned char>(cv::Mat &, const cv::Point &, const unsigned char &, const unsigned char);
     template cv::Mat FloodFill<cv::Vec3b>(cv::Mat &, const cv::Point &, const cv::Vec3b &, const unsigned char);
 
+    // Union-find over provisional labels. The root of a set is always its smallest label -> parent[label] <= label.
+    static int FindRoot(std::vector<int> &parent, int label)
+    {
+        while (parent[label] != label)
+        {
+            // Path halving
+            parent[label] = parent[parent[label]];
+            label = parent[label];
+        }
+
+        return label;
+    }
+
+    static int Union(std::vector<int> &parent, int label_a, int label_b)
+    {
+        label_a = FindRoot(parent, label_a);
+        label_b = FindRoot(parent, label_b);
+
+        if (label_a < label_b)
+        {
+            parent[label_b] = label_a;
+            return label_a;
+        }
+
+        parent[label_a] = label_b;
+        return label_b;
+    }
+
+    // Lock-free union used when merging strips from several threads. Only roots are ever modified (by CAS) and always
+    // linked to a smaller root, so concurrent unions cannot create cycles.
+    static void UnionAtomic(std::vector<int> &parent, int label_a, int label_b)
+    {
+        auto find_root = [&parent](int label)
+        {
+            int next;
+            while ((next = std::atomic_ref<int>(parent[label]).load(std::memory_order_acquire)) != label)
+            {
+                label = next;
+            }
+            return label;
+        };
+
+        while (true)
+        {
+            label_a = find_root(label_a);
+            label_b = find_root(label_b);
+
+            if (label_a == label_b)
+            {
+                return;
+            }
+
+            if (label_a < label_b)
+            {
+                std::swap(label_a, label_b);
+            }
+
+            // Link the larger root under the smaller one. Fails if label_a stopped being a root meanwhile -> retry.
+            int expected = label_a;
+            if (std::atomic_ref<int>(parent[label_a]).compare_exchange_weak(expected, label_b, std::memory_order_acq_rel))
+            {
+                return;
+            }
+        }
+    }
+
+    // Provisional labels a row can create: 4-connectivity -> at most one new label per two pixels
+    static inline int LabelsPerRow(int xmax)
+    {
+        return (xmax + 1) / 2;
+    }
+
+    // First pass over rows [y_begin, y_end): assigns provisional labels label_base + 1, label_base + 2, ... from the left and
+    // upper neighbours and records their equivalences. Rows above y_begin are not looked at. Returns the number of labels used.
+    // is_foreground(pixel) decides which pixels are labeled.
+    template <typename Foreground>
+    static int LabelRows(const cv::Mat &img, cv::Mat &img_labels, std::vector<int> &parent, int y_begin, int y_end, int label_base, const Foreground &is_foreground)
+    {
+        auto xmax = img.size[1];
+        int label = label_base;
+
+        for (int y = y_begin; y < y_end; y++)
+        {
+            const unsigned char *row = img.ptr<unsigned char>(y);
+            int *row_labels = img_labels.ptr<int>(y);
+            const int *row_labels_up = (y > y_begin) ? img_labels.ptr<int>(y - 1) : nullptr;
+
+            for (int x = 0; x < xmax; x++)
+            {
+                if (!is_foreground(row[x]))
+                {
+                    row_labels[x] = 0;
+                    continue;
+                }
+
+                bool left = x > 0 && row_labels[x - 1] != 0;
+                bool up = row_labels_up && row_labels_up[x] != 0;
+
+                if (left && up)
+                {
+                    row_labels[x] = (row_labels[x - 1] == row_labels_up[x]) ? row_labels[x - 1] : Union(parent, row_labels[x - 1], row_labels_up[x]);
+                }
+                else if (left)
+                {
+                    row_labels[x] = row_labels[x - 1];
+                }
+                else if (up)
+                {
+                    row_labels[x] = row_labels_up[x];
+                }
+                else
+                {
+                    label++;
+                    parent[label] = label;
+                    row_labels[x] = label;
+                }
+            }
+        }
+
+        return label - label_base;
+    }
+
+    // Turns roots of provisional labels label_base + 1 .. label_base + label_count into consecutive final labels (continuing
+    // from final_count) and points every other label directly to its final label. Ranges must be flattened in increasing order.
+    // Roots are the smallest (= first created) labels of their sets -> final labels follow the raster order.
+    static int FlattenLabels(std::vector<int> &parent, int label_base, int label_count, int final_count)
+    {
+        for (int label = label_base + 1; label <= label_base + label_count; label++)
+        {
+            // Non-root labels point to a smaller label which already holds its final label
+            parent[label] = (parent[label] == label) ? ++final_count : parent[parent[label]];
+        }
+
+        return final_count;
+    }
+
+    // Second pass over rows [y_begin, y_end): replaces provisional labels by final ones and gathers statistics.
+    // components must hold final_count zeroed entries, boxes final_count entries of (x_min, y_min, x_max, y_max).
+    static void RelabelRows(cv::Mat &img_labels, const std::vector<int> &parent, int y_begin, int y_end, ConnectedComponentsVector &components, std::vector<cv::Vec4i> &boxes)
+    {
+        auto xmax = img_labels.size[1];
+
+        for (int y = y_begin; y < y_end; y++)
+        {
+            int *row_labels = img_labels.ptr<int>(y);
+            for (int x = 0; x < xmax; x++)
+            {
+                if (row_labels[x] == 0)
+                {
+                    continue;
+                }
+
+                int label = parent[row_labels[x]];
+                row_labels[x] = label;
+
+                auto &component = components[label - 1];
+                if (component.area == 0)
+                {
+                    component.seed = cv::Point(x, y);
+                }
+                component.area++;
+
+                auto &box = boxes[label - 1];
+                box[0] = std::min(box[0], x);
+                box[1] = std::min(box[1], y);
+                box[2] = std::max(box[2], x);
+                box[3] = std::max(box[3], y);
+            }
+        }
+    }
+
+    static void ResetComponents(ConnectedComponentsVector &components, std::vector<cv::Vec4i> &boxes, int count, const cv::Size &size)
+    {
+        components.assign(count, ConnectedComponent());
+        boxes.assign(count, cv::Vec4i(size.width, size.height, -1, -1));
+    }
+
+    static void SetBoundingBoxes(ConnectedComponentsVector &components, const std::vector<cv::Vec4i> &boxes)
+    {
+        for (size_t i = 0; i < components.size(); i++)
+        {
+            components[i].label = static_cast<int>(i) + 1;
+            components[i].bounding_box = cv::Rect(boxes[i][0], boxes[i][1], boxes[i][2] - boxes[i][0] + 1, boxes[i][3] - boxes[i][1] + 1);
+        }
+    }
+
+    // Two-pass union-find labeling
+    template <typename Foreground>
+    static int LabelComponents(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, const Foreground &is_foreground)
+    {
+        assert(img.type() == CV_8UC1);
+
+        auto xmax = img.size[1];
+        auto ymax = img.size[0];
+
+        img_labels.create(ymax, xmax, CV_32SC1);
+
+        // Provisional label equivalences and bounding boxes. Reused between calls to avoid reallocating them for every frame.
+        thread_local std::vector<int> parent;
+        thread_local std::vector<cv::Vec4i> boxes;
+        parent.resize(static_cast<size_t>(ymax) * LabelsPerRow(xmax) + 1);
+
+        // 1. Provisional labels
+        int label_count = LabelRows(img, img_labels, parent, 0, ymax, 0, is_foreground);
+
+        // 2. Final labels
+        int final_count = FlattenLabels(parent, 0, label_count, 0);
+
+        // 3. Replace provisional labels and gather statistics
+        ResetComponents(components, boxes, final_count, img.size());
+        RelabelRows(img_labels, parent, 0, ymax, components, boxes);
+        SetBoundingBoxes(components, boxes);
+
+        return final_count;
+    }
+
+    struct ParallelLabelingBuffers
+    {
+        std::vector<int> parent;
+        std::vector<int> strip_label_counts;
+        std::vector<ConnectedComponentsVector> strip_components;
+        std::vector<std::vector<cv::Vec4i>> strip_boxes;
+    };
+
+    // Labels horizontal strips in parallel and merges them across the strip borders
+    template <typename Foreground>
+    static int LabelComponentsParallel(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, const Foreground &is_foreground, int strip_count)
+    {
+        assert(img.type() == CV_8UC1);
+
+        auto xmax = img.size[1];
+        auto ymax = img.size[0];
+
+        if (strip_count <= 0)
+        {
+            strip_count = cv::getNumThreads();
+        }
+        strip_count = std::max(1, std::min(strip_count, ymax / FLOODFILL_MIN_STRIP_HEIGHT));
+
+        img_labels.create(ymax, xmax, CV_32SC1);
+
+        // Buffers reused between calls. Bound to references -> the worker threads use the calling thread's instances.
+        thread_local ParallelLabelingBuffers buffers;
+        auto &parent = buffers.parent;
+        auto &strip_label_counts = buffers.strip_label_counts;
+        auto &strip_components = buffers.strip_components;
+        auto &strip_boxes = buffers.strip_boxes;
+
+        // Every strip owns the label range starting at strip_y_begin * LabelsPerRow -> provisional labels are unique
+        parent.resize(static_cast<size_t>(ymax) * LabelsPerRow(xmax) + 1);
+        strip_label_counts.assign(strip_count, 0);
+        strip_components.resize(strip_count);
+        strip_boxes.resize(strip_count);
+
+        auto strip_begin = [&](int strip)
+        { return static_cast<int>(static_cast<long long>(ymax) * strip / strip_count); };
+
+        // 1. Provisional labels of every strip independently
+        cv::parallel_for_(cv::Range(0, strip_count), [&](const cv::Range &range)
+                          {
+                              for (int strip = range.start; strip < range.end; strip++)
+                              {
+                                  auto y_begin = strip_begin(strip);
+                                  strip_label_counts[strip] = LabelRows(img, img_labels, parent, y_begin, strip_begin(strip + 1), y_begin * LabelsPerRow(xmax), is_foreground);
+                              } });
+
+        // 2. Merge labels touching across the strip borders
+        cv::parallel_for_(cv::Range(1, strip_count), [&](const cv::Range &range)
+                          {
+                              for (int strip = range.start; strip < range.end; strip++)
+                              {
+                                  auto y = strip_begin(strip);
+                                  const int *row_labels = img_labels.ptr<int>(y);
+                                  const int *row_labels_up = img_labels.ptr<int>(y - 1);
+
+                                  for (int x = 0; x < xmax; x++)
+                                  {
+                                      // Neighbouring pixels in a row mostly share labels -> skip repeated pairs
+                                      if (row_labels[x] && row_labels_up[x] && (x == 0 || row_labels[x] != row_labels[x - 1] || row_labels_up[x] != row_labels_up[x - 1]))
+                                      {
+                                          UnionAtomic(parent, row_labels[x], row_labels_up[x]);
+                                      }
+                                  }
+                              } });
+
+        // 3. Final labels in increasing order of the provisional labels
+        int final_count = 0;
+        for (int strip = 0; strip < strip_count; strip++)
+        {
+            final_count = FlattenLabels(parent, strip_begin(strip) * LabelsPerRow(xmax), strip_label_counts[strip], final_count);
+        }
+
+        // 4. Replace provisional labels and gather statistics of every strip
+        cv::parallel_for_(cv::Range(0, strip_count), [&](const cv::Range &range)
+                          {
+                              for (int strip = range.start; strip < range.end; strip++)
+                              {
+                                  ResetComponents(strip_components[strip], strip_boxes[strip], final_count, img.size());
+                                  RelabelRows(img_labels, parent, strip_begin(strip), strip_begin(strip + 1), strip_components[strip], strip_boxes[strip]);
+                              } });
+
+        // 5. Reduce the statistics. Strips are in raster order -> the first strip containing a component has its seed.
+        components.swap(strip_components[0]);
+        auto &boxes = strip_boxes[0];
+        for (int strip = 1; strip < strip_count; strip++)
+        {
+            for (int i = 0; i < final_count; i++)
+            {
+                const auto &component = strip_components[strip][i];
+                if (component.area == 0)
+                {
+                    continue;
+                }
+
+                if (components[i].area == 0)
+                {
+                    components[i].seed = component.seed;
+                }
+                components[i].area += component.area;
+
+                const auto &box = strip_boxes[strip][i];
+                boxes[i][0] = std::min(boxes[i][0], box[0]);
+                boxes[i][1] = std::min(boxes[i][1], box[1]);
+                boxes[i][2] = std::max(boxes[i][2], box[2]);
+                boxes[i][3] = std::max(boxes[i][3], box[3]);
+            }
+        }
+        SetBoundingBoxes(components, boxes);
+
+        return final_count;
+    }
+
+    int LabelConnectedComponents(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, unsigned char foreground)
+    {
+        return LabelComponents(img, img_labels, components, [foreground](unsigned char pixel)
+                               { return pixel == foreground; });
+    }
+
+    int LabelConnectedComponentsParallel(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, unsigned char foreground, int strip_count)
+    {
+        return LabelComponentsParallel(img, img_labels, components, [foreground](unsigned char pixel)
+                                       { return pixel == foreground; },
+                                       strip_count);
+    }
+
+    int LabelConnectedComponentsThreshold(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, unsigned char threshold, int strip_count)
+    {
+        auto is_foreground = [threshold](unsigned char pixel)
+        { return pixel > threshold; };
+
+        if (strip_count == 1)
+        {
+            return LabelComponents(img, img_labels, components, is_foreground);
+        }
+
+        return LabelComponentsParallel(img, img_labels, components, is_foreground, strip_count);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include "hog-detector.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace ano
+{
+#if defined(ANO_ENABLE_AVX2)
+    // Sum of the 8 floats of v
+    ANO_AVX2_TARGET static inline float HoGDetectorSum(__m256 v)
+    {
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        return _mm_cvtss_f32(sum);
+    }
+
+    // HoGDetectorDot over the first n - n % 8 floats, returns the number of floats processed
+    ANO_AVX2_TARGET static int HoGDetectorDotAVX2(const float *a, const float *b, int n, float &dot)
+    {
+        // 2 independent accumulators hide the FMA latency
+        int i = 0;
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        for (; i <= n - 16; i += 16)
+        {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+        }
+        for (; i <= n - 8; i += 8)
+        {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        }
+        dot = HoGDetectorSum(_mm256_add_ps(sum0, sum1));
+        return i;
+    }
+
+    // HoGDetectorDot4 over the first n - n % 8 floats, returns the number of floats processed
+    ANO_AVX2_TARGET static int HoGDetectorDot4AVX2(const float *w, const float *b, int stride, int n, float (&dot)[4])
+    {
+        int i = 0;
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps();
+        __m256 sum3 = _mm256_setzero_ps();
+        for (; i <= n - 8; i += 8)
+        {
+            __m256 weight = _mm256_loadu_ps(w + i);
+            sum0 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(b + i), sum0);
+            sum1 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(b + stride + i), sum1);
+            sum2 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(b + 2 * stride + i), sum2);
+            sum3 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(b + 3 * stride + i), sum3);
+        }
+        dot[0] = HoGDetectorSum(sum0);
+        dot[1] = HoGDetectorSum(sum1);
+        dot[2] = HoGDetectorSum(sum2);
+        dot[3] = HoGDetectorSum(sum3);
+        return i;
+    }
+#endif
+
+    // Dot product of n floats
+    static float HoGDetectorDot(const float *a, const float *b, int n)
+    {
+        int i = 0;
+        float dot = 0.0f;
+
+#if defined(ANO_ENABLE_AVX2)
+        if (HasAVX2())
+        {
+            i = HoGDetectorDotAVX2(a, b, n, dot);
+        }
+#endif
+
+        // Remaining floats (or all of them without AVX2)
+        for (; i < n; i++)
+        {
+            dot += a[i] * b[i];
+        }
+        return dot;
+    }
+
+    // Dot products of w with the 4 vectors b, b + stride, b + 2 * stride and b + 3 * stride (n floats each) added to out.
+    // Neighbouring windows in a block row are stride floats apart, so one load of w serves 4 windows.
+    static void HoGDetectorDot4(const float *w, const float *b, int stride, int n, float *out)
+    {
+        int i = 0;
+        float dot[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+#if defined(ANO_ENABLE_AVX2)
+        if (HasAVX2())
+        {
+            i = HoGDetectorDot4AVX2(w, b, stride, n, dot);
+        }
+#endif
+
+        for (; i < n; i++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                dot[k] += w[i] * b[k * stride + i];
+            }
+        }
+
+        for (int k = 0; k < 4; k++)
+        {
+            out[k] += dot[k];
+        }
+    }
+
+    void NonMaximumSuppression(HoGDetectionsVector &detections, float overlap_threshold)
+    {
+        std::sort(detections.begin(), detections.end(), [](const HoGDetection &a, const HoGDetection &b)
+                  { return a.score > b.score; });
+
+        // Kept detections are moved to the front
+        size_t kept_count = 0;
+        for (size_t i = 0; i < detections.size(); i++)
+        {
+            const auto &box = detections[i].box;
+
+            bool suppressed = false;
+            for (size_t k = 0; k < kept_count && !suppressed; k++)
+            {
+                const auto &kept_box = detections[k].box;
+                float intersection = static_cast<float>((box & kept_box).area());
+                float union_area = static_cast<float>(box.area() + kept_box.area()) - intersection;
+                suppressed = intersection > overlap_threshold * union_area;
+            }
+
+            if (!suppressed)
+            {
+                detections[kept_count++] = detections[i];
+            }
+        }
+        detections.resize(kept_count);
+    }
+
+    HoGDetector::HoGDetector(cv::Size window_size, int cell_size, int block_size, int nbins, int flags)
+        : window_size(window_size), window_cells(window_size.width / cell_size, window_size.height / cell_size),
+          cell_size(cell_size), block_size(block_size), nbins(nbins), flags(flags), pyramid(cell_size, block_size, nbins, HOG_PYRAMID_SCALE_STEP, HOG_PYRAMID_MAX_LEVELS, flags)
+    {
+        assert(window_size.width % cell_size == 0 && window_size.height % cell_size == 0);
+        assert(window_cells.width >= block_size && window_cells.height >= block_size);
+
+        // Same layout as HoGDescriptorGrid::Window
+        const int window_blocks_x = window_cells.width - block_size + 1;
+        const int window_blocks_y = window_cells.height - block_size + 1;
+        weights = cv::Mat::zeros(window_blocks_y, window_blocks_x * block_size * block_size * nbins, CV_32FC1);
+    }
+
+    void HoGDetector::Describe(const cv::Mat &window, float *descriptor) const
+    {
+        assert(window.size() == window_size);
+
+        HoGDescriptorGrid grid(cell_size, block_size, nbins);
+        grid.Compute(window);
+        grid.CopyWindow(0, 0, window_cells, descriptor);
+    }
+
+    void HoGDetector::Train(const std::vector<cv::Mat> &positives, const std::vector<cv::Mat> &negatives, float C, int epochs)
+    {
+        const int sample_count = static_cast<int>(positives.size() + negatives.size());
+        cv::Mat descriptors(sample_count, DescriptorLength(), CV_32FC1);
+        std::vector<int> labels(sample_count);
+
+        cv::parallel_for_(cv::Range(0, sample_count), [&](const cv::Range &range)
+                          {
+                              for (int i = range.start; i < range.end; i++)
+                              {
+                                  const bool is_positive = i < static_cast<int>(positives.size());
+                                  Describe(is_positive ? positives[i] : negatives[i - positives.size()], descriptors.ptr<float>(i));
+                                  labels[i] = is_positive ? 1 : -1;
+                              } });
+
+        Train(descriptors, labels, C, epochs);
+    }
+
+    // Linear SVM (hinge loss) trained by dual coordinate descent (Hsieh et al., ICML 2008). The bias is learned as the weight of an
+    // extra feature equal to 1. Every step updates one dual variable alpha_i in [0, C] and keeps w = sum(alpha_i * y_i * x_i).
+    void HoGDetector::Train(const cv::Mat &descriptors, const std::vector<int> &labels, float C, int epochs)
+    {
+        assert(descriptors.type() == CV_32FC1 && descriptors.size[1] == DescriptorLength());
+        assert(descriptors.size[0] == static_cast<int>(labels.size()));
+
+        const int sample_count = descriptors.size[0];
+        const int length = DescriptorLength();
+
+        // Continuous copy of the weights, written back at the end
+        std::vector<float> w(length, 0.0f);
+        float b = 0.0f;
+
+        std::vector<float> alpha(sample_count, 0.0f);
+        std::vector<float> squared_norms(sample_count);
+        for (int i = 0; i < sample_count; i++)
+        {
+            const float *x = descriptors.ptr<float>(i);
+            squared_norms[i] = HoGDetectorDot(x, x, length) + 1.0f; // + bias feature
+        }
+
+        std::vector<int> order(sample_count);
+        std::iota(order.begin(), order.end(), 0);
+        std::mt19937 generator(42);
+
+        for (int epoch = 0; epoch < epochs; epoch++)
+        {
+            std::shuffle(order.begin(), order.end(), generator);
+
+            float max_projected_gradient = -std::numeric_limits<float>::max();
+            float min_projected_gradient = std::numeric_limits<float>::max();
+            for (int i : order)
+            {
+                const float *x = descriptors.ptr<float>(i);
+                const float y = labels[i] > 0 ? 1.0f : -1.0f;
+
+                // Gradient of the dual objective, projected onto the box constraints
+                const float gradient = y * (HoGDetectorDot(w.data(), x, length) + b) - 1.0f;
+                float projected_gradient = gradient;
+                if (alpha[i] <= 0.0f)
+                {
+                    projected_gradient = std::min(gradient, 0.0f);
+                }
+                else if (alpha[i] >= C)
+                {
+                    projected_gradient = std::max(gradient, 0.0f);
+                }
+
+                max_projected_gradient = std::max(max_projected_gradient, projected_gradient);
+                min_projected_gradient = std::min(min_projected_gradient, projected_gradient);
+                if (projected_gradient == 0.0f)
+                {
+                    continue;
+                }
+
+                const float alpha_old = alpha[i];
+                alpha[i] = std::clamp(alpha[i] - gradient / squared_norms[i], 0.0f, C);
+
+                // w += (alpha_new - alpha_old) * y * x
+                const float delta = (alpha[i] - alpha_old) * y;
+                for (int k = 0; k < length; k++)
+                {
+                    w[k] += delta * x[k];
+                }
+                b += delta;
+            }
+
+            if (max_projected_gradient - min_projected_gradient < HOG_DETECTOR_SVM_TOLERANCE)
+            {
+                break;
+            }
+        }
+
+        std::copy(w.begin(), w.end(), weights.ptr<float>(0));
+        bias = b;
+    }
+
+    void HoGDetector::Score(const HoGDescriptorGrid &grid, cv::Mat &scores) const
+    {
+        const auto window_count = grid.WindowCount(window_cells);
+        const int block_length = grid.BlockLength();
+        const int weights_length = weights.size[1]; // One row of blocks of the window
+        assert(weights_length == grid.WindowBlocks(window_cells).width * block_length);
+
+        scores.create(window_count.height, window_count.width, CV_32FC1);
+
+        auto score_rows = [&](int y_begin, int y_end)
+        {
+            for (int y = y_begin; y < y_end; y++)
+            {
+                float *scores_row = scores.ptr<float>(y);
+                std::fill(scores_row, scores_row + window_count.width, bias);
+
+                // Window (x, y) = sum over its block rows y_block of weights row y_block . blocks row y + y_block from x
+                for (int y_block = 0; y_block < weights.size[0]; y_block++)
+                {
+                    const float *weights_row = weights.ptr<float>(y_block);
+                    const float *blocks_row = grid.Blocks().ptr<float>(y + y_block);
+
+                    int x = 0;
+                    for (; x <= window_count.width - 4; x += 4)
+                    {
+                        HoGDetectorDot4(weights_row, blocks_row + x * block_length, block_length, weights_length, scores_row + x);
+                    }
+                    for (; x < window_count.width; x++)
+                    {
+                        scores_row[x] += HoGDetectorDot(weights_row, blocks_row + x * block_length, weights_length);
+                    }
+                }
+            }
+        };
+
+        const int band_count = (flags & HOG_PARALLEL) ? std::clamp(window_count.height / HOG_MIN_BAND_CELL_ROWS, 1, cv::getNumThreads()) : 1;
+        if (band_count == 1)
+        {
+            score_rows(0, window_count.height);
+            return;
+        }
+
+        cv::parallel_for_(cv::Range(0, band_count), [&](const cv::Range &range)
+                          {
+                              for (int band = range.start; band < range.end; band++)
+                              {
+                                  score_rows(window_count.height * band / band_count, window_count.height * (band + 1) / band_count);
+                              } });
+    }
+
+    const HoGDetectionsVector &HoGDetector::Detect(const cv::Mat &img, float threshold, float overlap_threshold)
+    {
+        pyramid.Compute(img, window_size);
+
+        // Levels are scored in parallel like they are computed
+        const int level_count = pyramid.LevelCount();
+        if (static_cast<int>(level_scores.size()) < level_count)
+        {
+            level_scores.resize(level_count);
+        }
+        cv::parallel_for_(cv::Range(0, level_count), [&](const cv::Range &range)
+                          {
+                              for (int level = range.start; level < range.end; level++)
+                              {
+                                  Score(pyramid.Grid(level), level_scores[level]);
+                              } },
+                          level_count);
+
+        // Windows above the threshold in the image coordinates
+        detections.clear();
+        for (int level = 0; level < level_count; level++)
+        {
+            const auto scale = pyramid.Scale(level);
+            const auto &scores = level_scores[level];
+            for (int y = 0; y < scores.size[0]; y++)
+            {
+                const float *scores_row = scores.ptr<float>(y);
+                for (int x = 0; x < scores.size[1]; x++)
+                {
+                    if (scores_row[x] > threshold)
+                    {
+                        cv::Rect box(static_cast<int>(std::lround(x * cell_size * scale)), static_cast<int>(std::lround(y * cell_size * scale)),
+                                     static_cast<int>(std::lround(window_size.width * scale)), static_cast<int>(std::lround(window_size.height * scale)));
+                        detections.push_back({box, scores_row[x]});
+                    }
+                }
+            }
+        }
+
+        NonMaximumSuppression(detections, overlap_threshold);
+        return detections;
+    }
+
+    bool HoGDetector::Save(const cv::String &filename) const
+    {
+        cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+        if (!fs.isOpened())
+        {
+            return false;
+        }
+
+        fs << "window_width" << window_size.width << "window_height" << window_size.height
+           << "cell_size" << cell_size << "block_size" << block_size << "nbins" << nbins
+           << "bias" << bias << "weights" << weights;
+        return true;
+    }
+
+    bool HoGDetector::Load(const cv::String &filename)
+    {
+        cv::FileStorage fs(filename, cv::FileStorage::READ);
+        if (!fs.isOpened())
+        {
+            return false;
+        }
+
+        int window_width = 0, window_height = 0, file_cell_size = 0, file_block_size = 0, file_nbins = 0;
+        fs["window_width"] >> window_width;
+        fs["window_height"] >> window_height;
+        fs["cell_size"] >> file_cell_size;
+        fs["block_size"] >> file_block_size;
+        fs["nbins"] >> file_nbins;
+        if (cv::Size(window_width, window_height) != window_size || file_cell_size != cell_size || file_block_size != block_size || file_nbins != nbins)
+        {
+            return false;
+        }
+
+        cv::Mat file_weights;
+        fs["weights"] >> file_weights;
+        if (file_weights.size() != weights.size() || file_weights.type() != CV_32FC1)
+        {
+            return false;
+        }
+
+        file_weights.copyTo(weights);
+        fs["bias"] >> bias;
+        return true;
+    }
+}
\ No newline at end of file
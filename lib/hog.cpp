@@ -2,61 +2,140 @@
 // Histogram of Oriented Gradients (HOG) descriptor
 
 #include <vector>
+#include <algorithm>
 #include <cmath>
+#include <utility>
+
+#include "image-gradient.hpp"
 
 namespace ano
 {
-    // Compute HOG
-    // If cells_in_block_count * cell_size != image size -> the histogram is averaged from less pixels
-    cv::Mat HoG(const cv::Mat &img_gradients, const int cells_in_block_count, const int cell_size, const int nbins)
+    // Row scratch of HoGAccumulateCells. One per thread, reused by every call -> no allocations once it is big enough.
+    struct HoGRowScratch
     {
-        int y_cell_count = static_cast<int>(std::ceil(img_gradients.size[0] / static_cast<float>(cell_size))); // How many cells in y dir
-        int x_cell_count = static_cast<int>(std::ceil(img_gradients.size[1] / static_cast<float>(cell_size))); // How many cells in x dir
+        cv::Mat grey_rows[2];
+        std::vector<unsigned char> bins;
+        std::vector<float> magnitude;
+    };
+
+    // Runs function(begin, end) on bands of at least min_band items of [0, count) on separate threads with HOG_PARALLEL,
+    // otherwise once for everything
+    template <typename Function>
+    static void HoGForBands(int count, int min_band, int flags, const Function &function)
+    {
+        const int band_count = (flags & HOG_PARALLEL) ? std::clamp(count / min_band, 1, cv::getNumThreads()) : 1;
+        if (band_count == 1)
+        {
+            function(0, count);
+            return;
+        }
+
+        cv::parallel_for_(cv::Range(0, band_count), [&](const cv::Range &range)
+                          {
+                              for (int band = range.start; band < range.end; band++)
+                              {
+                                  function(count * band / band_count, count * (band + 1) / band_count);
+                              } });
+    }
+
+    // Unnormalized histograms of cell rows [y_cell_begin, y_cell_end) of a raw 8-bit image in a single pass: every row gets its
+    // gradient bins into a row of scratch and is added to the cell histograms right away. Only 2 greyscale rows (for BGR input)
+    // and 1 row of bins + magnitudes are kept.
+    static void HoGAccumulateCellRows(const cv::Mat &img, cv::Mat &img_histogram, const int cell_size, const int nbins, int y_cell_begin, int y_cell_end)
+    {
+        const int w = img.size[1];
+        const int h = img.size[0];
+        const int x_cell_count = img_histogram.size[1];
+        const int y_begin = y_cell_begin * cell_size;
+        const int y_end = std::min(y_cell_end * cell_size, h);
+
+        thread_local HoGRowScratch thread_scratch;
+        auto &scratch = thread_scratch;
+        scratch.bins.resize(w);
+        scratch.magnitude.resize(w);
+
+        const bool is_color = img.channels() == 3;
+        if (is_color)
+        {
+            scratch.grey_rows[0].create(1, w, CV_8UC1);
+            scratch.grey_rows[1].create(1, w, CV_8UC1);
+            cv::cvtColor(img.row(std::min(y_begin, h - 2)), scratch.grey_rows[0], cv::COLOR_BGR2GRAY);
+        }
 
-        int y_block_count = static_cast<int>(std::ceil(img_gradients.size[0] / static_cast<float>(cells_in_block_count * cell_size))); // How many blocks in x dir
-        int x_block_count = static_cast<int>(std::ceil(img_gradients.size[1] / static_cast<float>(cells_in_block_count * cell_size))); // How many blocks in x dir
+        for (int y_cell = y_cell_begin; y_cell < y_cell_end; y_cell++)
+        {
+            float *histogram_row = img_histogram.ptr<float>(y_cell);
+            std::fill(histogram_row, histogram_row + x_cell_count * nbins, 0.0f);
+        }
 
-        int block_size_pixels = cells_in_block_count * cell_size; // Size of block in pixels
+        int last_src_y = -1;
+        for (int y = y_begin; y < y_end; y++)
+        {
+            // The last row duplicates the gradients of the previous one -> keep the scratch
+            const int src_y = std::min(y, h - 2);
+            if (src_y != last_src_y)
+            {
+                const unsigned char *row = img.ptr<unsigned char>(src_y);
+                const unsigned char *row_below = img.ptr<unsigned char>(src_y + 1);
+                if (is_color)
+                {
+                    cv::cvtColor(img.row(src_y + 1), scratch.grey_rows[1], cv::COLOR_BGR2GRAY);
+                    row = scratch.grey_rows[0].ptr<unsigned char>(0);
+                    row_below = scratch.grey_rows[1].ptr<unsigned char>(0);
+                }
 
-        // 1. Add gradient magnitudes to cell's histogram and Sum all gradients in each block
+                ComputeGradientBinsRow(row, row_below, w, scratch.bins.data(), scratch.magnitude.data(), nbins);
+                last_src_y = src_y;
 
-        // Gradient histogram for every cell
-        float *histogram = new float[y_cell_count * x_cell_count * nbins];            // n ints for every orientation + 1 for pixel count ()
-        float *histogram_end = histogram + (y_cell_count * x_cell_count * nbins + 1); // Iterator end
-        float *histogram_it = histogram;                                              // Iterator
+                if (is_color)
+                {
+                    std::swap(scratch.grey_rows[0], scratch.grey_rows[1]);
+                }
+            }
 
-        // Zero the histogram counts
-        memset(histogram, 0, y_cell_count * x_cell_count * nbins);
+            float *histogram_row = img_histogram.ptr<float>(y / cell_size);
+            for (int x_cell = 0; x_cell < x_cell_count; x_cell++)
+            {
+                float *histogram_it = histogram_row + x_cell * nbins;
+                const int x_end = std::min(w, (x_cell + 1) * cell_size);
+                for (int x = x_cell * cell_size; x < x_end; x++)
+                {
+                    histogram_it[scratch.bins[x]] += scratch.magnitude[x];
+                }
+            }
+        }
+    }
 
-        // Sum of all bins in block
-        float *histogram_block_sum = new float[y_block_count * x_block_count]; // n floats for every orientation + 1 for pixel count ()
+    // Unnormalized histograms of cell rows [y_cell_begin, y_cell_end) of a gradient field from ComputeGradients (CV_32FC2)
+    static void HoGAccumulateCellRowsFromGradients(const cv::Mat &img_gradients, cv::Mat &img_histogram, const int cell_size, const int nbins, int y_cell_begin, int y_cell_end)
+    {
+        const int x_cell_count = img_histogram.size[1];
+        const int y_begin = y_cell_begin * cell_size;
+        const int y_end = std::min(y_cell_end * cell_size, img_gradients.size[0]);
 
-        // Zero the histogram counts
-        memset(histogram_block_sum, 0, y_block_count * x_block_count);
+        for (int y_cell = y_cell_begin; y_cell < y_cell_end; y_cell++)
+        {
+            float *histogram_row = img_histogram.ptr<float>(y_cell);
+            std::fill(histogram_row, histogram_row + x_cell_count * nbins, 0.0f);
+        }
 
         // Angle difference between bins
-
         const float bin_delta = 2.0f * M_PIf / nbins;
 
         // For every pixel in y direction
-        for (int y = 0; y < img_gradients.size[0]; y++)
+        for (int y = y_begin; y < y_end; y++)
         {
-            // Current cell in y dir
-            int y_cell = y / cell_size;
-            int y_block = y / block_size_pixels;
+            const cv::Vec2f *gradients_row = img_gradients.ptr<cv::Vec2f>(y);
+            float *histogram_row = img_histogram.ptr<float>(y / cell_size);
 
             // For every pixel in x direction
             for (int x = 0; x < img_gradients.size[1]; x++)
             {
-                // Current cell in x dir
-                int x_cell = x / cell_size;
-                int x_block = x / block_size_pixels;
-
                 // Move pointer to current cell's histogram counts
-                histogram_it = histogram + ((y_cell * x_cell_count + x_cell) * nbins);
+                float *histogram_it = histogram_row + (x / cell_size) * nbins;
 
                 // Calculate bin
-                auto pixel = img_gradients.at<cv::Vec2f>(y, x);
+                auto pixel = gradients_row[x];
                 auto pixel_angle = std::min(std::max(pixel[0], -M_PIf + 1e-4f), M_PIf - 1e-4f); // Exclude -PI and +PI -> due to finding the bins
 
                 int bin = static_cast<int>(std::floor((pixel_angle + M_PIf) / bin_delta)); // Move from [-PI, PI] to [0, 2*PI]
@@ -64,46 +143,241 @@ namespace ano
                 assert(bin >= 0 && bin < nbins);
 
                 // Add gradient magnitude to bin histogram
-                *(histogram_it + bin) += pixel[1];
-
-                // Sum gradient magnitudes in block
-                histogram_block_sum[y_block * x_block_count + x_block] += pixel[1];
+                histogram_it[bin] += pixel[1];
             }
         }
+    }
+
+    // Unnormalized cell histograms of a raw 8-bit image (CV_8UC3 / CV_8UC1) or a gradient field (CV_32FC2).
+    // img_histogram is (re)allocated as CV_32FC(nbins) with HoGCellCount cells. Bands of cell rows are independent -> HOG_PARALLEL
+    // gives every thread its own band.
+    static void HoGAccumulateCells(const cv::Mat &img, cv::Mat &img_histogram, const int cell_size, const int nbins, int flags)
+    {
+        assert(img.type() == CV_8UC1 || img.type() == CV_8UC3 || img.type() == CV_32FC2);
+        assert(img.size[0] >= 2 && img.size[1] >= 2);
+
+        const auto cell_count = HoGCellCount(img.size(), cell_size);
+        img_histogram.create(cell_count.height, cell_count.width, CV_32FC(nbins));
+
+        HoGForBands(cell_count.height, HOG_MIN_BAND_CELL_ROWS, flags, [&](int y_cell_begin, int y_cell_end)
+                    {
+                        if (img.depth() == CV_8U)
+                        {
+                            HoGAccumulateCellRows(img, img_histogram, cell_size, nbins, y_cell_begin, y_cell_end);
+                        }
+                        else
+                        {
+                            HoGAccumulateCellRowsFromGradients(img, img_histogram, cell_size, nbins, y_cell_begin, y_cell_end);
+                        } });
+    }
+
+    // Normalizes the cell's histograms by the gradient sum of their block (non-overlapping blocks of cells_in_block_count^2 cells)
+    // in place. Blocks without any gradient stay 0. Block rows are independent -> split into bands with HOG_PARALLEL.
+    static void HoGNormalizeByBlocks(cv::Mat &img_histogram, const int cells_in_block_count, int flags)
+    {
+        const int nbins = img_histogram.channels();
+        const int y_cell_count = img_histogram.size[0];
+        const int x_cell_count = img_histogram.size[1];
+        const int y_block_count = (y_cell_count + cells_in_block_count - 1) / cells_in_block_count;
+
+        HoGForBands(y_block_count, std::max(HOG_MIN_BAND_CELL_ROWS / cells_in_block_count, 1), flags, [&](int y_block_begin, int y_block_end)
+                    {
+                        for (int y_block = y_block_begin * cells_in_block_count; y_block < y_block_end * cells_in_block_count; y_block += cells_in_block_count)
+                        {
+                            const int y_end = std::min(y_block + cells_in_block_count, y_cell_count);
+                            for (int x_block = 0; x_block < x_cell_count; x_block += cells_in_block_count)
+                            {
+                                // Cells of one block row are next to each other
+                                const int begin = x_block * nbins;
+                                const int end = std::min(x_block + cells_in_block_count, x_cell_count) * nbins;
+
+                                // Sum all gradients in the block
+                                float block_sum = 0.0f;
+                                for (int y_cell = y_block; y_cell < y_end; y_cell++)
+                                {
+                                    const float *histogram_row = img_histogram.ptr<float>(y_cell);
+                                    for (int i = begin; i < end; i++)
+                                    {
+                                        block_sum += histogram_row[i];
+                                    }
+                                }
+
+                                if (block_sum <= 0.0f)
+                                {
+                                    continue;
+                                }
+
+                                // Normalize cell's histogram by block's gradient sum
+                                const float scale = 1.0f / block_sum;
+                                for (int y_cell = y_block; y_cell < y_end; y_cell++)
+                                {
+                                    float *histogram_row = img_histogram.ptr<float>(y_cell);
+                                    for (int i = begin; i < end; i++)
+                                    {
+                                        histogram_row[i] *= scale;
+                                    }
+                                }
+                            }
+                        } });
+    }
+
+    // Compute HOG
+    // If cells_in_block_count * cell_size != image size -> the histogram is averaged from less pixels
+    void HoG(const cv::Mat &img, cv::Mat &hog, const int cells_in_block_count, const int cell_size, const int nbins, const int flags)
+    {
+        // 1. Add gradient magnitudes to cell's histogram (raw image -> gradients are never stored)
+        HoGAccumulateCells(img, hog, cell_size, nbins, flags);
 
         // 2. Normalize the cell's histogram by block's gradient sum
+        HoGNormalizeByBlocks(hog, cells_in_block_count, flags);
+    }
 
-        // For every cell in y direction
-        for (int y_cell = 0; y_cell < y_cell_count; y_cell++)
-        {
-            // Current cell in y dir
-            int y_block = y_cell / cells_in_block_count;
+    void HoG(const cv::Mat &img, std::span<float> hog, const int cells_in_block_count, const int cell_size, const int nbins, const int flags)
+    {
+        const auto cell_count = HoGCellCount(img.size(), cell_size);
+        CV_Assert(hog.size() == static_cast<size_t>(cell_count.area()) * nbins);
 
-            // For every cell in x direction
-            for (int x_cell = 0; x_cell < x_cell_count; x_cell++)
-            {
-                // Current cell in x direction
-                int x_block = x_cell / cells_in_block_count;
+        // Header over the caller's memory, create() keeps it as the size and type match
+        cv::Mat hog_view(cell_count.height, cell_count.width, CV_32FC(nbins), hog.data());
+        HoG(img, hog_view, cells_in_block_count, cell_size, nbins, flags);
+    }
 
-                // Move pointer to current cell's histogram counts
-                histogram_it = histogram + ((y_cell * x_cell_count + x_cell) * nbins);
+    cv::Mat HoG(const cv::Mat &img, const int cells_in_block_count, const int cell_size, const int nbins, const int flags)
+    {
+        cv::Mat hog;
+        HoG(img, hog, cells_in_block_count, cell_size, nbins, flags);
+        return hog;
+    }
 
-                // Normalize cell's histogram by block's gradient sum
-                for (int i = 0; i < nbins; i++)
-                {
-                    histogram_it[i] /= histogram_block_sum[y_block * x_block_count + x_block];
-                }
-            }
+    HoGDescriptorGrid::HoGDescriptorGrid(int cell_size, int block_size, int nbins, int flags)
+        : cell_size(cell_size), block_size(block_size), nbins(nbins), flags(flags)
+    {
+        assert(cell_size > 0 && block_size > 0 && nbins > 0 && nbins <= 256);
+    }
+
+    void HoGDescriptorGrid::Compute(const cv::Mat &img)
+    {
+        HoGAccumulateCells(img, cells, cell_size, nbins, flags);
+
+        const int y_block_count = std::max(cells.size[0] - block_size + 1, 0);
+        const int x_block_count = std::max(cells.size[1] - block_size + 1, 0);
+        const int block_length = BlockLength();
+        const int block_row_length = block_size * nbins; // Cells of one block row are next to each other in cells
+
+        blocks.create(y_block_count, x_block_count * block_length, CV_32FC1);
+
+        // Blocks only read the cells -> rows of blocks are independent
+        HoGForBands(y_block_count, HOG_MIN_BAND_CELL_ROWS, flags, [&](int y_block_begin, int y_block_end)
+                    {
+                        for (int y_block = y_block_begin; y_block < y_block_end; y_block++)
+                        {
+                            float *block = blocks.ptr<float>(y_block);
+                            for (int x_block = 0; x_block < x_block_count; x_block++, block += block_length)
+                            {
+                                // Gather the block's cells (row by row) and L2-Hys normalize them
+                                for (int y_cell = 0; y_cell < block_size; y_cell++)
+                                {
+                                    const float *cells_row = cells.ptr<float>(y_block + y_cell) + x_block * nbins;
+                                    std::copy(cells_row, cells_row + block_row_length, block + y_cell * block_row_length);
+                                }
+
+                                for (int pass = 0; pass < 2; pass++)
+                                {
+                                    float sum_squares = 0.0f;
+                                    for (int i = 0; i < block_length; i++)
+                                    {
+                                        sum_squares += block[i] * block[i];
+                                    }
+
+                                    const float scale = 1.0f / std::sqrt(sum_squares + HOG_BLOCK_EPSILON * HOG_BLOCK_EPSILON);
+                                    for (int i = 0; i < block_length; i++)
+                                    {
+                                        // Clip after the first normalization only
+                                        block[i] = pass == 0 ? std::min(block[i] * scale, HOG_L2HYS_CLIP) : block[i] * scale;
+                                    }
+                                }
+                            }
+                        } });
+    }
+
+    cv::Size HoGDescriptorGrid::WindowBlocks(cv::Size window_cells) const
+    {
+        assert(window_cells.width >= block_size && window_cells.height >= block_size);
+        return cv::Size(window_cells.width - block_size + 1, window_cells.height - block_size + 1);
+    }
+
+    cv::Size HoGDescriptorGrid::WindowCount(cv::Size window_cells) const
+    {
+        auto window_blocks = WindowBlocks(window_cells);
+        return cv::Size(std::max(BlockCount().width - window_blocks.width + 1, 0), std::max(BlockCount().height - window_blocks.height + 1, 0));
+    }
+
+    int HoGDescriptorGrid::DescriptorLength(cv::Size window_cells) const
+    {
+        return WindowBlocks(window_cells).area() * BlockLength();
+    }
+
+    cv::Mat HoGDescriptorGrid::Window(int x_cell, int y_cell, cv::Size window_cells) const
+    {
+        auto window_blocks = WindowBlocks(window_cells);
+        assert(x_cell >= 0 && y_cell >= 0);
+        assert(x_cell + window_blocks.width <= BlockCount().width && y_cell + window_blocks.height <= BlockCount().height);
+
+        return blocks(cv::Rect(x_cell * BlockLength(), y_cell, window_blocks.width * BlockLength(), window_blocks.height));
+    }
+
+    void HoGDescriptorGrid::CopyWindow(int x_cell, int y_cell, cv::Size window_cells, float *descriptor) const
+    {
+        auto window = Window(x_cell, y_cell, window_cells);
+        for (int y = 0; y < window.size[0]; y++)
+        {
+            const float *row = window.ptr<float>(y);
+            descriptor = std::copy(row, row + window.size[1], descriptor);
         }
+    }
 
-        // Ctor with *data does not copy the data from pointer and DOES NOT DEALOCATE the data -> do a copy a be done with it
-        cv::Mat img_histogram = cv::Mat(y_cell_count, x_cell_count, CV_32FC(nbins), histogram, cv::Mat::AUTO_STEP).clone(); // The final histogram
+    HoGPyramid::HoGPyramid(int cell_size, int block_size, int nbins, double scale_step, int max_levels, int flags)
+        : scale_step(scale_step), max_levels(max_levels), images(max_levels), grids(max_levels, HoGDescriptorGrid(cell_size, block_size, nbins, flags)), scales(max_levels)
+    {
+        assert(scale_step > 1.0 && max_levels > 0);
+    }
 
-        delete[] (histogram_block_sum);
-        delete[] (histogram);
+    void HoGPyramid::Compute(const cv::Mat &img, cv::Size min_size)
+    {
+        // Level sizes
+        std::vector<cv::Size> sizes;
+        double scale = 1.0;
+        for (int level = 0; level < max_levels; level++, scale *= scale_step)
+        {
+            cv::Size size(static_cast<int>(std::lround(img.size[1] / scale)), static_cast<int>(std::lround(img.size[0] / scale)));
+            if (size.width < min_size.width || size.height < min_size.height)
+            {
+                break;
+            }
 
-        return img_histogram;
+            sizes.push_back(size);
+            scales[level] = scale;
+        }
+        level_count = static_cast<int>(sizes.size());
+
+        // Every level is resized from the full image, so levels do not wait for each other
+        cv::parallel_for_(cv::Range(0, level_count), [&](const cv::Range &range)
+                          {
+                              for (int level = range.start; level < range.end; level++)
+                              {
+                                  if (level == 0)
+                                  {
+                                      images[level] = img;
+                                  }
+                                  else
+                                  {
+                                      cv::resize(img, images[level], sizes[level], 0, 0, cv::INTER_AREA);
+                                  }
+                                  grids[level].Compute(images[level]);
+                              } },
+                          level_count);
     }
+
 #include "text.hpp"
 
     cv::Mat HoGVisualizeByAlpha(const cv::Mat &hog, const int cell_size, const int nbins, const float color_multiply)
@@ -1,56 +1,293 @@
 #include "image-gradient.hpp"
+#include "simd.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 namespace ano
 {
+    // atan(t) ~= t * (A1 + A3 t^2 + ... + A11 t^10) for t in [0, 1], max error ~1e-5 rad
+#define GRADIENT_ATAN_A1 (0.99997726f)
+#define GRADIENT_ATAN_A3 (-0.33262347f)
+#define GRADIENT_ATAN_A5 (0.19354346f)
+#define GRADIENT_ATAN_A7 (-0.11643287f)
+#define GRADIENT_ATAN_A9 (0.05265332f)
+#define GRADIENT_ATAN_A11 (-0.01172120f)
 
-    cv::Mat ComputeGradients(const cv::Mat &img, int start_x, int start_y, int w, int h)
+    // Orientations are clamped into (-PI, PI) before quantization, so +-PI do not get their own bin
+#define GRADIENT_BIN_ANGLE_EPSILON (1e-4f)
+
+    // Approximates atan2(dy, dx), dx and dy are integers (no -0.0f)
+    static inline float GradientAtan2(float dy, float dx)
     {
-        cv::Mat img_greyscale;
-        cv::cvtColor(img, img_greyscale, cv::COLOR_BGR2GRAY);
+        auto ax = std::abs(dx), ay = std::abs(dy);
 
-        assert(start_x >= 0 && start_y >= 0);
-        assert(start_x + w <= img.size[1] && start_y + h <= img.size[0]);
+        // Reduce to atan(t) with t in [0, 1]
+        auto t = std::min(ax, ay) / std::max(std::max(ax, ay), 1.0f);
+        auto t2 = t * t;
+        auto angle = ((((GRADIENT_ATAN_A11 * t2 + GRADIENT_ATAN_A9) * t2 + GRADIENT_ATAN_A7) * t2 + GRADIENT_ATAN_A5) * t2 + GRADIENT_ATAN_A3) * t2 + GRADIENT_ATAN_A1;
+        angle *= t;
 
-        cv::Mat gradients(h, w, CV_32FC2);
+        // Back to the full circle
+        angle = ay > ax ? M_PI_2f - angle : angle;
+        angle = dx < 0.0f ? M_PIf - angle : angle;
+        return dy < 0.0f ? -angle : angle;
+    }
+
+#if defined(ANO_ENABLE_AVX2)
+    // GradientAtan2 for 8 pixels
+    ANO_AVX2_TARGET static inline __m256 GradientAtan2(__m256 dy, __m256 dx)
+    {
+        const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+        __m256 ax = _mm256_andnot_ps(sign_mask, dx);
+        __m256 ay = _mm256_andnot_ps(sign_mask, dy);
+
+        __m256 t = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(1.0f)));
+        __m256 t2 = _mm256_mul_ps(t, t);
+        __m256 angle = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(GRADIENT_ATAN_A11), t2), _mm256_set1_ps(GRADIENT_ATAN_A9));
+        angle = _mm256_add_ps(_mm256_mul_ps(angle, t2), _mm256_set1_ps(GRADIENT_ATAN_A7));
+        angle = _mm256_add_ps(_mm256_mul_ps(angle, t2), _mm256_set1_ps(GRADIENT_ATAN_A5));
+        angle = _mm256_add_ps(_mm256_mul_ps(angle, t2), _mm256_set1_ps(GRADIENT_ATAN_A3));
+        angle = _mm256_add_ps(_mm256_mul_ps(angle, t2), _mm256_set1_ps(GRADIENT_ATAN_A1));
+        angle = _mm256_mul_ps(angle, t);
+
+        angle = _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps(M_PI_2f), angle), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+        angle = _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps(M_PIf), angle), dx);   // Sign bit of dx selects
+        return _mm256_xor_ps(angle, _mm256_and_ps(dy, sign_mask));                           // Copy the sign of dy
+    }
+#endif
 
-        // Calculate all color differences between neighbours (excluding last row and col)
-        for (int y = 0; y < h - 1; y++)
+    // Writes interleaved (orientation, magnitude) pairs -> CV_32FC2
+    struct GradientInterleavedWriter
+    {
+        float *out;
+
+        void operator()(int x, float orientation, float magnitude) const
         {
-            for (int x = 0; x < w - 1; x++)
-            {
-                auto dX = img_greyscale.at<unsigned char>(start_y + y, start_x + x + 1) - img_greyscale.at<unsigned char>(start_y + y, start_x + x);
-                auto dY = img_greyscale.at<unsigned char>(start_y + y + 1, start_x + x) - img_greyscale.at<unsigned char>(start_y + y, start_x + x);
+            out[2 * x] = orientation;
+            out[2 * x + 1] = magnitude;
+        }
 
-                // Calculate gradient magnitude and orientation
-                auto orientation = std::atan2(dY, dX);
-                auto magnitude = std::sqrt(dX * dX + dY * dY);
+#if defined(ANO_ENABLE_AVX2)
+        ANO_AVX2_TARGET void operator()(int x, __m256 orientation, __m256 magnitude) const
+        {
+            // [o0 m0 o1 m1 | o4 m4 o5 m5] and [o2 m2 o3 m3 | o6 m6 o7 m7] -> swap the middle 128 bit lanes
+            __m256 low = _mm256_unpacklo_ps(orientation, magnitude);
+            __m256 high = _mm256_unpackhi_ps(orientation, magnitude);
+            _mm256_storeu_ps(out + 2 * x, _mm256_permute2f128_ps(low, high, 0x20));
+            _mm256_storeu_ps(out + 2 * x + 8, _mm256_permute2f128_ps(low, high, 0x31));
+        }
+#endif
+    };
 
-                gradients.at<cv::Vec2f>(y, x) = cv::Vec2f(orientation, magnitude);
-            }
+    // Writes orientation and magnitude into separate planes
+    struct GradientPlanarWriter
+    {
+        float *orientation_out;
+        float *magnitude_out;
+
+        void operator()(int x, float orientation, float magnitude) const
+        {
+            orientation_out[x] = orientation;
+            magnitude_out[x] = magnitude;
         }
 
-        // If the part we are calculating is containing right edge
-        if (start_x + w == img.size[1])
+#if defined(ANO_ENABLE_AVX2)
+        ANO_AVX2_TARGET void operator()(int x, __m256 orientation, __m256 magnitude) const
         {
-            // Duplicate values on the right edge
-            for (int y = 0; y < h; y++)
-            {
-                gradients.at<cv::Vec2f>(y, w - 1) = gradients.at<cv::Vec2f>(y, w - 2);
-            }
+            _mm256_storeu_ps(orientation_out + x, orientation);
+            _mm256_storeu_ps(magnitude_out + x, magnitude);
+        }
+#endif
+    };
+
+    // Writes the orientation bin and the magnitude
+    struct GradientBinWriter
+    {
+        unsigned char *bins_out;
+        float *magnitude_out;
+        float bin_delta;
+        int nbins;
+
+        void operator()(int x, float orientation, float magnitude) const
+        {
+            auto angle = std::clamp(orientation, -M_PIf + GRADIENT_BIN_ANGLE_EPSILON, M_PIf - GRADIENT_BIN_ANGLE_EPSILON);
+            auto bin = static_cast<int>((angle + M_PIf) / bin_delta); // Positive -> truncation == floor
+            bins_out[x] = static_cast<unsigned char>(std::min(bin, nbins - 1));
+            magnitude_out[x] = magnitude;
+        }
+
+#if defined(ANO_ENABLE_AVX2)
+        ANO_AVX2_TARGET void operator()(int x, __m256 orientation, __m256 magnitude) const
+        {
+            __m256 angle = _mm256_max_ps(orientation, _mm256_set1_ps(-M_PIf + GRADIENT_BIN_ANGLE_EPSILON));
+            angle = _mm256_min_ps(angle, _mm256_set1_ps(M_PIf - GRADIENT_BIN_ANGLE_EPSILON));
+            __m256i bin = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_add_ps(angle, _mm256_set1_ps(M_PIf)), _mm256_set1_ps(bin_delta)));
+            bin = _mm256_min_epi32(bin, _mm256_set1_epi32(nbins - 1));
+
+            // 8 x int32 -> 8 x uint8
+            __m128i bin16 = _mm_packs_epi32(_mm256_castsi256_si128(bin), _mm256_extracti128_si256(bin, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(bins_out + x), _mm_packus_epi16(bin16, bin16));
+            _mm256_storeu_ps(magnitude_out + x, magnitude);
+        }
+#endif
+    };
+
+#if defined(ANO_ENABLE_AVX2)
+    // GradientRow for 8 pixels at once (reads row[x, x + 8]), returns the number of pixels processed
+    template <typename Writer>
+    ANO_AVX2_TARGET static int GradientRowAVX2(const unsigned char *row, const unsigned char *row_below, int count, int x_out, const Writer &writer)
+    {
+        int x = 0;
+        for (; x <= count - 8; x += 8)
+        {
+            __m256i center = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(row + x)));
+            __m256i right = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(row + x + 1)));
+            __m256i below = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(row_below + x)));
+
+            __m256 dX = _mm256_cvtepi32_ps(_mm256_sub_epi32(right, center));
+            __m256 dY = _mm256_cvtepi32_ps(_mm256_sub_epi32(below, center));
+
+            __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dX, dX), _mm256_mul_ps(dY, dY)));
+            writer(x_out + x, GradientAtan2(dY, dX), magnitude);
+        }
+        return x;
+    }
+#endif
+
+    // Gradients of pixels [0, count) of a greyscale row, row[count] (right neighbour of the last pixel) must exist.
+    // Pixel x is passed to writer as x_out + x.
+    template <typename Writer>
+    static void GradientRow(const unsigned char *row, const unsigned char *row_below, int count, int x_out, const Writer &writer)
+    {
+        int x = 0;
+
+#if defined(ANO_ENABLE_AVX2)
+        if (HasAVX2())
+        {
+            x = GradientRowAVX2(row, row_below, count, x_out, writer);
         }
+#endif
 
-        // If the part we are calculating is containing right edge
-        if (start_y + h == img.size[0])
+        // Remaining pixels (or all of them without AVX2)
+        for (; x < count; x++)
         {
-            // Duplicate values on the bottom edge
-            for (int x = 0; x < w; x++)
+            auto dX = static_cast<float>(row[x + 1] - row[x]);
+            auto dY = static_cast<float>(row_below[x] - row[x]);
+            writer(x_out + x, GradientAtan2(dY, dX), std::sqrt(dX * dX + dY * dY));
+        }
+    }
+
+    // Converts img to greyscale unless it already is
+    static void GradientGreyscale(const cv::Mat &img, cv::Mat &img_greyscale)
+    {
+        if (img.channels() == 1)
+        {
+            img_greyscale = img;
+        }
+        else
+        {
+            cv::cvtColor(img, img_greyscale, cv::COLOR_BGR2GRAY);
+        }
+        assert(img_greyscale.type() == CV_8UC1);
+        assert(img.size[0] >= 2 && img.size[1] >= 2);
+    }
+
+    // Gradients of the w x h part of img_greyscale starting at (start_x, start_y). make_writer(y) returns the writer of output row y.
+    template <typename MakeWriter>
+    static void GradientRows(const cv::Mat &img_greyscale, int start_x, int start_y, int w, int h, int flags, const MakeWriter &make_writer)
+    {
+        // Differences are taken to the right and bottom neighbour, which may lie outside of the part.
+        // The last row and col of the image have no such neighbour, they duplicate the previous row / col.
+        const int last_x = img_greyscale.size[1] - 2;
+        const int last_y = img_greyscale.size[0] - 2;
+        const int direct_count = std::clamp(last_x - start_x + 1, 0, w); // Pixels with their own right neighbour
+
+        auto process_rows = [&](int y_begin, int y_end)
+        {
+            for (int y = y_begin; y < y_end; y++)
             {
-                gradients.at<cv::Vec2f>(h - 1, x) = gradients.at<cv::Vec2f>(h - 2, x);
+                auto src_y = std::min(start_y + y, last_y);
+                const unsigned char *row = img_greyscale.ptr<unsigned char>(src_y);
+                const unsigned char *row_below = img_greyscale.ptr<unsigned char>(src_y + 1);
+                auto writer = make_writer(y);
+
+                GradientRow(row + start_x, row_below + start_x, direct_count, 0, writer);
+                for (int x = direct_count; x < w; x++)
+                {
+                    GradientRow(row + last_x, row_below + last_x, 1, x, writer);
+                }
             }
+        };
+
+        const int band_count = (flags & GRADIENT_PARALLEL) ? std::clamp(h / GRADIENT_MIN_BAND_HEIGHT, 1, cv::getNumThreads()) : 1;
+        if (band_count == 1)
+        {
+            process_rows(0, h);
+            return;
+        }
+
+        cv::parallel_for_(cv::Range(0, band_count), [&](const cv::Range &range)
+                          {
+                              for (int band = range.start; band < range.end; band++)
+                              {
+                                  process_rows(h * band / band_count, h * (band + 1) / band_count);
+                              } });
+    }
+
+    cv::Mat ComputeGradients(const cv::Mat &img, int start_x, int start_y, int w, int h, int flags)
+    {
+        assert(start_x >= 0 && start_y >= 0);
+        assert(start_x + w <= img.size[1] && start_y + h <= img.size[0]);
+
+        // Already computed gradient field -> just view the requested part
+        if (img.type() == CV_32FC2)
+        {
+            return img(cv::Rect(start_x, start_y, w, h));
         }
 
+        // Greyscale images are used directly, only color ones have to be converted
+        cv::Mat img_greyscale;
+        GradientGreyscale(img, img_greyscale);
+
+        cv::Mat gradients(h, w, CV_32FC2);
+        GradientRows(img_greyscale, start_x, start_y, w, h, flags, [&](int y)
+                     { return GradientInterleavedWriter{gradients.ptr<float>(y)}; });
+
         return gradients;
     }
-}
+
+    void ComputeGradients(const cv::Mat &img, cv::Mat &orientation, cv::Mat &magnitude, int flags)
+    {
+        cv::Mat img_greyscale;
+        GradientGreyscale(img, img_greyscale);
+
+        orientation.create(img.size(), CV_32FC1);
+        magnitude.create(img.size(), CV_32FC1);
+        GradientRows(img_greyscale, 0, 0, img.size[1], img.size[0], flags, [&](int y)
+                     { return GradientPlanarWriter{orientation.ptr<float>(y), magnitude.ptr<float>(y)}; });
+    }
+
+    void ComputeGradientBins(const cv::Mat &img, cv::Mat &bins, cv::Mat &magnitude, int nbins, int flags)
+    {
+        assert(nbins > 0 && nbins <= 256);
+
+        cv::Mat img_greyscale;
+        GradientGreyscale(img, img_greyscale);
+
+        bins.create(img.size(), CV_8UC1);
+        magnitude.create(img.size(), CV_32FC1);
+        const float bin_delta = 2.0f * M_PIf / nbins;
+        GradientRows(img_greyscale, 0, 0, img.size[1], img.size[0], flags, [&](int y)
+                     { return GradientBinWriter{bins.ptr<unsigned char>(y), magnitude.ptr<float>(y), bin_delta, nbins}; });
+    }
+
+    void ComputeGradientBinsRow(const unsigned char *row, const unsigned char *row_below, int w, unsigned char *bins, float *magnitude, int nbins)
+    {
+        assert(w >= 2 && nbins > 0 && nbins <= 256);
+
+        const GradientBinWriter writer{bins, magnitude, 2.0f * M_PIf / nbins, nbins};
+        GradientRow(row, row_below, w - 1, 0, writer);
+        GradientRow(row + w - 2, row_below + w - 2, 1, w - 1, writer);
+    }
+}
\ No newline at end of file
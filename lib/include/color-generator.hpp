@@ -12,4 +12,8 @@ namespace ano
     // lightness - the lightness of the random color. Divides the mixed color by this value
     cv::Vec3b GenerateRandomColorBGR(const cv::Vec3b &color_base = cv::Vec3b(255, 255, 255), float mix_ratio_base = 0.5f, float lightness = 1.0f);
 
+    // Paints labels 1..label_count of a CV_32SC1 label image with random colors mixed with color_base. Label 0 stays black.
+    // img_out is (re)allocated as CV_8UC3.
+    void ColorizeLabels(const cv::Mat &img_labels, cv::Mat &img_out, int label_count, const cv::Vec3b &color_base = cv::Vec3b(255, 255, 255));
+
 }
\ No newline at end of file
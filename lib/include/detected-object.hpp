@@ -26,11 +26,11 @@ namespace ano
         int y = 0;
         int width = 0;
         int height = 0;
-        unsigned char id_pixel = 0;
+        int id_pixel = 0; // Color or label of the object's pixels
         unsigned char id_class = 0;
         DetectedObjectFeatures features;
 
-        DetectedObject(unsigned char id_pixel, unsigned char id_class, int x, int y, int width = 0, int height = 0, const DetectedObjectFeatures &features = DetectedObjectFeatures(cv::Vec2i(0, 0), 0.0, 0.0, 0.0))
+        DetectedObject(int id_pixel, unsigned char id_class, int x, int y, int width = 0, int height = 0, const DetectedObjectFeatures &features = DetectedObjectFeatures(cv::Vec2i(0, 0), 0.0, 0.0, 0.0))
             : id_pixel(id_pixel), id_class(id_class), x(x), y(y), width(width), height(height), features(features)
         {
         }
@@ -51,7 +51,7 @@ namespace ano
 
     using DetectedObjectsVector = std::vector<DetectedObject>;
 
-    DetectedObjectsVector::iterator DetectedObjectsVectorGetByPixelID(DetectedObjectsVector &detected_objects, unsigned char id_pixel);
+    DetectedObjectsVector::iterator DetectedObjectsVectorGetByPixelID(DetectedObjectsVector &detected_objects, int id_pixel);
 
-    void DetectedObjectsVectorSetClass(DetectedObjectsVector &detected_objects, unsigned char id_pixel, unsigned char id_class);
+    void DetectedObjectsVectorSetClass(DetectedObjectsVector &detected_objects, int id_pixel, unsigned char id_class);
 }
\ No newline at end of file
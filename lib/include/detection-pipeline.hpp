@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "floodfill.hpp"
+#include "moments.hpp"
+#include "detected-object.hpp"
+#include "ethalons.hpp"
+#include "spsc-queue.hpp"
+
+namespace ano
+{
+    // Intermediate results of a single processed frame. All buffers are kept between frames and only grow.
+    struct DetectionFrame
+    {
+        cv::Mat image;                        // Input grayscale image (DetectionPipeline::Process references the caller's data)
+        cv::Mat image_threshold;              // Binary image (empty when thresholding is fused into labeling)
+        cv::Mat image_labels;                 // CV_32SC1 labels: 0 = background, 1..N = objects in raster order
+        ConnectedComponentsVector components; // components[i] describes label i + 1
+        MomentFeaturesTable moments;          // Moments indexed by label
+        DetectedObjectsVector objects;        // objects[i] describes label i + 1, id_pixel == label
+    };
+
+    // Threshold -> Labeling -> Moments -> Classification of a stream of grayscale frames.
+    // Configured once and reused for every frame. After the first frames of a given size the pipeline performs no heap
+    // allocations, as every stage writes to the buffers owned by its DetectionFrame.
+    class DetectionPipeline
+    {
+    public:
+        // threshold - pixels > threshold are foreground
+        // fuse_threshold - label the grayscale image directly without materializing image_threshold
+        // strip_count - number of strips labeled in parallel (see LabelConnectedComponentsParallel), 1 = sequential
+        DetectionPipeline(unsigned char threshold, bool fuse_threshold = true, int strip_count = 1);
+
+        // Ethalons used for classification. Without them the objects keep id_class == 0.
+        void SetEthalons(const Ethalons &ethalons);
+        const Ethalons &GetEthalons() const { return ethalons; }
+        unsigned char GetThreshold() const { return threshold; }
+
+        // Runs all stages on the image (CV_8UC1). The result stays valid until the next call.
+        const DetectedObjectsVector &Process(const cv::Mat &image);
+
+        // Buffers of the last processed frame
+        const DetectionFrame &Frame() const { return frame; }
+
+        // Single stages working on any frame, e.g. to run them on different threads. They only read the configuration.
+        void Threshold(DetectionFrame &frame) const;
+        void Label(DetectionFrame &frame) const;
+        void ExtractFeatures(DetectionFrame &frame) const;
+        void Classify(DetectionFrame &frame) const;
+
+    private:
+        unsigned char threshold;
+        bool fuse_threshold;
+        int strip_count;
+        bool has_ethalons = false;
+        Ethalons ethalons;
+        DetectionFrame frame;
+    };
+
+    // Default number of frames in flight of StreamingDetectionPipeline
+#define DETECTION_PIPELINE_STREAM_SLOTS (8)
+
+    // Runs the stages of a DetectionPipeline on a stream of frames with every stage on its own thread: frame N + 1 is thresholded
+    // while frame N is labeled, frame N - 1 has its features extracted and frame N - 2 is classified. Throughput is limited by
+    // the slowest stage instead of the sum of all stages. The stages pass preallocated frame slots through bounded lock-free
+    // queues, so there are no heap allocations per frame once every slot has seen a frame of the stream's size. Stages with
+    // nothing to do sleep until a frame arrives. Push and Close must be called from one producer thread (Close queues an
+    // end of stream marker behind the last pushed frame), Pop and Release from one consumer thread.
+    class StreamingDetectionPipeline
+    {
+    public:
+        // stages - configuration of the stages (threshold, ethalons, ...). It is copied.
+        // slot_count - maximal number of frames in flight. Push blocks while all of them are in use.
+        explicit StreamingDetectionPipeline(const DetectionPipeline &stages, int slot_count = DETECTION_PIPELINE_STREAM_SLOTS);
+        // Closes the stream and joins the stage threads. Frames that were not popped are dropped.
+        ~StreamingDetectionPipeline();
+
+        StreamingDetectionPipeline(const StreamingDetectionPipeline &) = delete;
+        StreamingDetectionPipeline &operator=(const StreamingDetectionPipeline &) = delete;
+
+        // Copies the image (CV_8UC1) to a free slot and queues it. Blocks while no slot is free. Returns false after Close.
+        bool Push(const cv::Mat &image);
+        // Ends the stream. Frames in flight are still processed and can be popped. Call it from the thread calling Push.
+        void Close();
+
+        // Waits for the next processed frame in push order. Returns nullptr when the stream is closed and drained.
+        // The frame stays valid until it is given back by Release.
+        const DetectionFrame *Pop();
+        void Release(const DetectionFrame *frame);
+
+    private:
+        static constexpr int stage_count = 4;
+        // Slot index passed through the queues after the last frame
+        static constexpr int end_of_stream = -1;
+
+        void RunStage(int stage);
+
+        DetectionPipeline stages;
+        std::vector<DetectionFrame> slots;
+        // Slot indices: queues[0] = free slots, queues[i + 1] = input of stage i, queues[stage_count + 1] = processed frames
+        std::array<std::unique_ptr<SPSCQueue<int>>, stage_count + 2> queues;
+        std::atomic<bool> closed = false;
+        // Consumer side: the end of stream marker was popped
+        bool drained = false;
+        std::vector<std::thread> threads;
+    };
+}
\ No newline at end of file
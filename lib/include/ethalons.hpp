@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <vector>
 #include <tuple>
+#include <span>
 
 #include <opencv2/opencv.hpp>
 
@@ -42,6 +43,8 @@ namespace ano
         cv::Vec3b GetColorByClass(unsigned char id_class);
 
         // Find closest class id of ethalon from given values
-        unsigned char FindClosestClass(const std::vector<float> &ethalons);
+        unsigned char FindClosestClass(const std::vector<float> &ethalons) const;
+        // Find closest class id of ethalon from given values without copying them to a vector
+        unsigned char FindClosestClass(std::span<const float> ethalons) const;
     };
 }
\ No newline at end of file
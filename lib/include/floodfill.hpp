@@ -1,17 +1,62 @@
 #pragma once
 
+#include <vector>
+
 #include <opencv2/opencv.hpp>
 
 namespace ano
 {
 
+    // Line segment waiting to be filled: left end, right end, row and direction (1 = down, -1 = up)
+    struct FloodFillSpan
+    {
+        int xl;
+        int xr;
+        int y;
+        int dy;
+    };
+
+    // Preallocated storage for the spans of a fill. Keeps its capacity between fills.
+    using FloodFillSpanStack = std::vector<FloodFillSpan>;
+
+    // Fills the 4-connected region of 255 pixels around the starting pixel: sets them to index in img and to color in img_out.
+    // Regions touching the image edges are handled (no background border is needed).
     template <typename T>
     void FloodFillInPlace(cv::Mat &img, cv::Mat &img_out, const cv::Point &starting_pixel, const T &color, const unsigned char index = 128);
     template <typename T>
     void FloodFillInPlace(cv::Mat &img, cv::Mat &img_out, int starting_x, int starting_y, const T &color, const unsigned char index = 128);
+    // Same as above with a caller provided span stack (the other overloads use a thread local one)
     template <typename T>
-    inline cv::Mat FloodFill(cv::Mat &img, const cv::Point &starting_pixel, const T &color, const unsigned char index = 128);
+    void FloodFillInPlace(cv::Mat &img, cv::Mat &img_out, int starting_x, int starting_y, const T &color, const unsigned char index, FloodFillSpanStack &stack);
     template <typename T>
-    inline cv::Mat FloodFill(cv::Mat &img, int starting_x, int starting_y, const T &color, const unsigned char index = 128);
+    cv::Mat FloodFill(cv::Mat &img, const cv::Point &starting_pixel, const T &color, const unsigned char index = 128);
+    template <typename T>
+    cv::Mat FloodFill(cv::Mat &img, int starting_x, int starting_y, const T &color, const unsigned char index = 128);
+
+    // Statistics of a single connected component
+    struct ConnectedComponent
+    {
+        int label = 0;         // Value of the component's pixels in the label image
+        int area = 0;          // Pixel count
+        cv::Rect bounding_box; // Smallest rectangle containing the component
+        cv::Point seed;        // First pixel of the component in raster order
+    };
+
+    using ConnectedComponentsVector = std::vector<ConnectedComponent>;
+
+    // Labels 4-connected components of pixels equal to foreground in a CV_8UC1 image (the input is not modified).
+    // img_labels is (re)allocated as CV_32SC1: 0 = background, 1..N = components in raster order of their first pixel.
+    // components[i] holds the statistics of label i + 1. Returns N.
+    int LabelConnectedComponents(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, unsigned char foreground = 255);
+
+    // Minimal number of rows of a strip labeled by a single thread
+#define FLOODFILL_MIN_STRIP_HEIGHT (32)
+
+    // Same as LabelConnectedComponents, but labels strip_count horizontal strips on separate threads and merges the labels across
+    // the strip borders with a lock-free union-find. strip_count <= 0 -> one strip per thread (cv::getNumThreads).
+    int LabelConnectedComponentsParallel(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, unsigned char foreground = 255, int strip_count = 0);
 
+    // Threshold fused into the labeling: labels components of pixels > threshold of a grayscale image directly, without
+    // materializing the binary image (same foreground as ano::Threshold). strip_count != 1 -> LabelConnectedComponentsParallel.
+    int LabelConnectedComponentsThreshold(const cv::Mat &img, cv::Mat &img_labels, ConnectedComponentsVector &components, unsigned char threshold, int strip_count = 1);
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "hog.hpp"
+
+namespace ano
+{
+    // Soft margin constant C of the linear SVM and the maximal number of passes over the training set
+#define HOG_DETECTOR_SVM_C (0.01f)
+#define HOG_DETECTOR_SVM_EPOCHS (100)
+    // Training stops once the projected gradients of all samples are within this range (dual coordinate descent)
+#define HOG_DETECTOR_SVM_TOLERANCE (0.01f)
+
+    // Detections overlapping a better one by more than this (intersection over union) are suppressed
+#define HOG_DETECTOR_NMS_OVERLAP (0.3f)
+
+    struct HoGDetection
+    {
+        cv::Rect box;       // Window in the image coordinates
+        float score = 0.0f; // SVM decision value, > 0 = object
+    };
+
+    using HoGDetectionsVector = std::vector<HoGDetection>;
+
+    // Greedy non-maximum suppression: keeps the best scoring detections, drops every detection overlapping a kept one by more
+    // than overlap_threshold (intersection over union). The result is sorted by score (best first).
+    void NonMaximumSuppression(HoGDetectionsVector &detections, float overlap_threshold = HOG_DETECTOR_NMS_OVERLAP);
+
+    // Sliding window detector: a linear SVM over the HoGDescriptorGrid descriptors of fixed size windows (Dalal & Triggs).
+    // The weights have the layout of a window view (rows of blocks), so a window is scored straight from the block grid.
+    // Scoring correlates every row of weights with the block rows of the grid, 4 neighbouring windows share each weight load.
+    // Multi-scale detection runs on a HoGPyramid, all buffers are reused between frames.
+    class HoGDetector
+    {
+    public:
+        // window_size must be a multiple of cell_size
+        // flags - HOG_* flags of the descriptor grids
+        HoGDetector(cv::Size window_size = cv::Size(64, 128), int cell_size = 8, int block_size = 2, int nbins = 9, int flags = 0);
+
+        // Trains the SVM on window_size BGR / greyscale crops of objects (positives) and of background (negatives)
+        void Train(const std::vector<cv::Mat> &positives, const std::vector<cv::Mat> &negatives, float C = HOG_DETECTOR_SVM_C, int epochs = HOG_DETECTOR_SVM_EPOCHS);
+        // Trains the SVM on descriptors (CV_32FC1, one DescriptorLength() row per sample) labeled +1 (object) / -1 (background)
+        void Train(const cv::Mat &descriptors, const std::vector<int> &labels, float C = HOG_DETECTOR_SVM_C, int epochs = HOG_DETECTOR_SVM_EPOCHS);
+
+        // Descriptor of a window_size crop into DescriptorLength() floats (e.g. for hard negative mining)
+        void Describe(const cv::Mat &window, float *descriptor) const;
+        int DescriptorLength() const { return weights.size[0] * weights.size[1]; }
+
+        // SVM decision values of all windows of a grid (CV_32FC1, grid.WindowCount() big). Score (x, y) is the window with its top
+        // left cell at (x, y).
+        void Score(const HoGDescriptorGrid &grid, cv::Mat &scores) const;
+
+        // Detects the objects at all pyramid levels with a score above threshold followed by NonMaximumSuppression.
+        // The result stays valid until the next call.
+        const HoGDetectionsVector &Detect(const cv::Mat &img, float threshold = 0.0f, float overlap_threshold = HOG_DETECTOR_NMS_OVERLAP);
+
+        // FileStorage (yml / xml) with the window and HoG parameters, the weights and the bias
+        bool Save(const cv::String &filename) const;
+        // Fails when the file can not be read or its parameters differ from this detector's
+        bool Load(const cv::String &filename);
+
+        cv::Size WindowSize() const { return window_size; }
+        // Weights in the window view layout (CV_32FC1)
+        const cv::Mat &Weights() const { return weights; }
+        float Bias() const { return bias; }
+        const HoGPyramid &Pyramid() const { return pyramid; }
+
+    private:
+        cv::Size window_size;
+        cv::Size window_cells;
+        int cell_size;
+        int block_size;
+        int nbins;
+        int flags;
+
+        cv::Mat weights;
+        float bias = 0.0f;
+
+        HoGPyramid pyramid;
+        std::vector<cv::Mat> level_scores;
+        HoGDetectionsVector detections;
+    };
+}
\ No newline at end of file
@@ -5,11 +5,121 @@
 //    http://en.wikipedia.org/wiki/Histogram_of_oriented_gradients
 //    http://mrl.cs.vsb.cz/people/gaura/ano/hog.pdf
 
+#include <span>
+#include <vector>
+
 #include <opencv2/opencv.hpp>
 
 namespace ano
 {
-    cv::Mat HoG(const cv::Mat &img, int block_size, int cell_size, int nbins = 9);
+    // HoG flags
+    // Cell histograms are accumulated and normalized in bands of cell rows on separate threads (same result as the sequential version)
+#define HOG_PARALLEL (1 << 0)
+
+    // Minimal number of cell rows of a band processed by a single thread with HOG_PARALLEL
+#define HOG_MIN_BAND_CELL_ROWS (4)
+
+    // Number of cells of an image, partial cells at the right and bottom edge count
+    inline cv::Size HoGCellCount(cv::Size image_size, int cell_size)
+    {
+        return cv::Size((image_size.width + cell_size - 1) / cell_size, (image_size.height + cell_size - 1) / cell_size);
+    }
+
+    // Cell histograms (CV_32FC(nbins)) normalized by the gradient sum of their block of block_size x block_size cells.
+    // img is either a gradient field from ComputeGradients (CV_32FC2) or a raw BGR / greyscale image (CV_8UC3 / CV_8UC1).
+    // The raw image is processed in a single pass without storing its gradients.
+    // flags - combination of the HOG_* flags above
+    cv::Mat HoG(const cv::Mat &img, int block_size, int cell_size, int nbins = 9, int flags = 0);
+    // HoG into a caller owned buffer. hog is (re)allocated only when its size or type differ, so a per-frame loop reusing it
+    // does not allocate.
+    void HoG(const cv::Mat &img, cv::Mat &hog, int block_size, int cell_size, int nbins = 9, int flags = 0);
+    // HoG into HoGCellCount(img.size(), cell_size).area() * nbins floats (row-major cells, nbins floats each).
+    // Throws cv::Exception when the span has a different size.
+    void HoG(const cv::Mat &img, std::span<float> hog, int block_size, int cell_size, int nbins = 9, int flags = 0);
+
+    // Blocks of HoGDescriptorGrid are L2-Hys normalized: v / sqrt(|v|^2 + EPSILON^2), clipped to CLIP and normalized again
+#define HOG_BLOCK_EPSILON (1e-3f)
+#define HOG_L2HYS_CLIP (0.2f)
+
+    // Dense HoG for sliding window detection (Dalal & Triggs). Compute() accumulates the cell histograms of an image once and
+    // normalizes every block of block_size x block_size cells with a stride of 1 cell, so neighbouring blocks overlap.
+    // The descriptor of a window is the concatenation of the blocks it contains and is handed out as a view into the block buffer,
+    // scanning windows does not compute or copy anything. Buffers are reused between images of the same size.
+    class HoGDescriptorGrid
+    {
+    public:
+        // flags - combination of the HOG_* flags
+        HoGDescriptorGrid(int cell_size = 8, int block_size = 2, int nbins = 9, int flags = 0);
+
+        // Computes the cells and blocks of a raw BGR / greyscale image (CV_8UC3 / CV_8UC1) or a gradient field (CV_32FC2)
+        void Compute(const cv::Mat &img);
+
+        // Descriptor of the window of window_cells cells with its top left cell at (x_cell, y_cell). The view has WindowBlocks().height rows
+        // of WindowBlocks().width * BlockLength() floats (one row of blocks each), their concatenation is the descriptor.
+        cv::Mat Window(int x_cell, int y_cell, cv::Size window_cells) const;
+        // Copies the window descriptor into DescriptorLength() continuous floats (e.g. for training)
+        void CopyWindow(int x_cell, int y_cell, cv::Size window_cells, float *descriptor) const;
+
+        // Number of blocks of a window
+        cv::Size WindowBlocks(cv::Size window_cells) const;
+        // Number of window positions in the image (top left cells)
+        cv::Size WindowCount(cv::Size window_cells) const;
+        int DescriptorLength(cv::Size window_cells) const;
+
+        int CellSize() const { return cell_size; }
+        int BlockSize() const { return block_size; }
+        int Bins() const { return nbins; }
+        // Floats of one normalized block
+        int BlockLength() const { return block_size * block_size * nbins; }
+        cv::Size BlockCount() const { return cv::Size(BlockLength() ? blocks.size[1] / BlockLength() : 0, blocks.size[0]); }
+
+        // Unnormalized cell histograms (CV_32FC(nbins))
+        const cv::Mat &Cells() const { return cells; }
+        // Normalized blocks (CV_32FC1), BlockCount().height rows of BlockCount().width * BlockLength() floats
+        const cv::Mat &Blocks() const { return blocks; }
+
+    private:
+        int cell_size;
+        int block_size;
+        int nbins;
+        int flags;
+
+        cv::Mat cells;
+        cv::Mat blocks;
+    };
+
+    // Default ratio of the sizes of 2 neighbouring HoGPyramid levels and the maximal level count
+#define HOG_PYRAMID_SCALE_STEP (1.2)
+#define HOG_PYRAMID_MAX_LEVELS (16)
+
+    // Multi-scale dense HoG: level 0 is the image itself, every next level is scale_step times smaller. Every level gets its own
+    // HoGDescriptorGrid, levels are resized and computed in parallel. Images and grids are reused between frames of the same size,
+    // so a fixed size window matches objects scale_step^level times bigger in the original image.
+    class HoGPyramid
+    {
+    public:
+        // flags - HOG_* flags of the level grids
+        HoGPyramid(int cell_size = 8, int block_size = 2, int nbins = 9, double scale_step = HOG_PYRAMID_SCALE_STEP, int max_levels = HOG_PYRAMID_MAX_LEVELS, int flags = 0);
+
+        // Computes all levels of a raw BGR / greyscale image (CV_8UC3 / CV_8UC1) that are at least min_size big (e.g. the window size)
+        void Compute(const cv::Mat &img, cv::Size min_size);
+
+        int LevelCount() const { return level_count; }
+        const HoGDescriptorGrid &Grid(int level) const { return grids[level]; }
+        const cv::Mat &Image(int level) const { return images[level]; }
+        // Level coordinates * Scale(level) -> image coordinates
+        double Scale(int level) const { return scales[level]; }
+
+    private:
+        double scale_step;
+        int max_levels;
+
+        int level_count = 0;
+        std::vector<cv::Mat> images;
+        std::vector<HoGDescriptorGrid> grids;
+        std::vector<double> scales;
+    };
+
     cv::Mat HoGVisualizeByAlpha(const cv::Mat &hog, const int cell_size, const int nbins, const float color_multiply = 2.0f);
     cv::Mat HoGVisualizeByLenght(const cv::Mat &hog, const int cell_size, const int nbins, const float length_multiply = 16.0f);
 }
\ No newline at end of file
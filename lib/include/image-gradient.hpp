@@ -4,17 +4,41 @@
 
 namespace ano
 {
+    // Gradient flags
+    // Rows are processed in horizontal bands on separate threads
+#define GRADIENT_PARALLEL (1 << 0)
+
+    // Minimal number of rows of a band processed by a single thread with GRADIENT_PARALLEL
+#define GRADIENT_MIN_BAND_HEIGHT (32)
+
+    // Orientations are computed by a polynomial atan2 approximation (max error ~1e-5 rad), with AVX2 8 pixels at once.
+    // dX and dY are forward differences of the greyscale image, the last row and col of the image duplicate the previous ones.
+
     // Calculate gradients of part of the image. Both magnitude and orintation (angle -> 1 variable)
     // Returned angles are in radians from -PI to PI!!!
-    cv::Mat ComputeGradients(const cv::Mat &img, int x, int y, int w, int h);
+    // img can be BGR (CV_8UC3), already greyscale (CV_8UC1) or a gradient field computed before (CV_32FC2).
+    // The gradient field is not recomputed, the returned Mat is a view into it.
+    cv::Mat ComputeGradients(const cv::Mat &img, int x, int y, int w, int h, int flags = 0);
 
     // Calculate gradients of the whole image. Both magnitude and orintation (angle -> 1 variable)
     // Returned angles are in radians from -PI to PI!!!
-    inline cv::Mat ComputeGradients(const cv::Mat &img)
+    inline cv::Mat ComputeGradients(const cv::Mat &img, int flags = 0)
     {
-        return ComputeGradients(img, 0, 0, img.size[1], img.size[0]);
+        return ComputeGradients(img, 0, 0, img.size[1], img.size[0], flags);
     }
 
+    // Calculate gradients of the whole BGR or greyscale image into separate planes.
+    // orientation (radians from -PI to PI) and magnitude are (re)allocated as CV_32FC1.
+    void ComputeGradients(const cv::Mat &img, cv::Mat &orientation, cv::Mat &magnitude, int flags = 0);
+
+    // Calculate gradients of the whole BGR or greyscale image with the orientation quantized to nbins bins over [-PI, PI]
+    // (bin = floor((angle + PI) / (2 PI / nbins)), same as HoG). bins are (re)allocated as CV_8UC1, magnitude as CV_32FC1.
+    void ComputeGradientBins(const cv::Mat &img, cv::Mat &bins, cv::Mat &magnitude, int nbins, int flags = 0);
+
+    // ComputeGradientBins of a single row of w >= 2 greyscale pixels, row_below is the next image row. The last pixel duplicates
+    // the previous one (the last image row duplicates the previous row). For consumers streaming through the image a row at a time.
+    void ComputeGradientBinsRow(const unsigned char *row, const unsigned char *row_below, int w, unsigned char *bins, float *magnitude, int nbins);
+
     // Calculates color difference between 2 colors just like euclidian distance
     inline float DiffColor(const cv::Vec3b &color1, const cv::Vec3b &color2)
     {
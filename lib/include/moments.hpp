@@ -2,39 +2,299 @@
 
 #include <cassert>
 #include <type_traits>
+#include <vector>
+#include <limits>
+#include <array>
+#include <utility>
+#include <cmath>
+#include <cstdint>
 
 #include <opencv2/opencv.hpp>
 
+// Highest order p + q of the exact compile time kernels (64 bit integer accumulation).
+// On a 4K frame m22 or m31 of a large object already exceeds the range of long long.
+#define MOMENTS_MAX_KERNEL_ORDER (3)
+
 namespace ano
 {
+    // v^p for compile time p
+    template <int p, typename V>
+    constexpr V IntPow(V v)
+    {
+        if constexpr (p == 0)
+        {
+            return V(1);
+        }
+        else
+        {
+            return v * IntPow<p - 1>(v);
+        }
+    }
+
+    namespace detail
+    {
+#if defined(__SIZEOF_INT128__)
+        // a * b - c * d computed exactly and rounded once to double
+        inline double ProductDifference(long long a, long long b, long long c, long long d)
+        {
+            return static_cast<double>(static_cast<__int128>(a) * b - static_cast<__int128>(c) * d);
+        }
+#else
+        // Portable fallback without __int128 (e.g. MSVC): 128 bit two's complement value in two 64 bit words
+        struct Int128Words
+        {
+            std::uint64_t hi, lo;
+        };
+
+        inline Int128Words Negate(Int128Words v)
+        {
+            v.lo = ~v.lo + 1;
+            v.hi = ~v.hi + (v.lo == 0 ? 1 : 0);
+            return v;
+        }
+
+        // Full 128 bit product from 32 bit halves of |a| and |b|
+        inline Int128Words Multiply(long long a, long long b)
+        {
+            const std::uint64_t ua = (a < 0) ? 0 - static_cast<std::uint64_t>(a) : static_cast<std::uint64_t>(a);
+            const std::uint64_t ub = (b < 0) ? 0 - static_cast<std::uint64_t>(b) : static_cast<std::uint64_t>(b);
+
+            const std::uint64_t a_lo = ua & 0xffffffff, a_hi = ua >> 32;
+            const std::uint64_t b_lo = ub & 0xffffffff, b_hi = ub >> 32;
+            const std::uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+            const std::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+
+            Int128Words product{hi_hi + (hi_lo >> 32) + (cross >> 32), (cross << 32) | (lo_lo & 0xffffffff)};
+            return ((a < 0) != (b < 0)) ? Negate(product) : product;
+        }
+
+        // a * b - c * d computed exactly, the conversion to double rounds the two words separately
+        inline double ProductDifference(long long a, long long b, long long c, long long d)
+        {
+            const Int128Words ab = Multiply(a, b);
+            const Int128Words minus_cd = Negate(Multiply(c, d));
+
+            Int128Words difference{ab.hi + minus_cd.hi, ab.lo + minus_cd.lo};
+            difference.hi += (difference.lo < ab.lo) ? 1 : 0;
+
+            const bool negative = (difference.hi >> 63) != 0;
+            if (negative)
+            {
+                difference = Negate(difference);
+            }
+            const double magnitude = std::ldexp(static_cast<double>(difference.hi), 64) + static_cast<double>(difference.lo);
+            return negative ? -magnitude : magnitude;
+        }
+#endif
+    }
+
+    // Raw moments m_ij for all i <= p and j <= q of the given color in a single pass.
+    // Every row is reduced to sums of x^i first (vectorizable), the row sums are then multiplied by y^j.
+    // Accumulates in 64 bit integers -> exact for 4K frames up to p + q == MOMENTS_MAX_KERNEL_ORDER.
+    template <int p, int q, typename T>
+    void RawMoments(const cv::Mat &img, const T &color, long long (&m)[p + 1][q + 1])
+    {
+        static_assert(p + q <= MOMENTS_MAX_KERNEL_ORDER, "integer moments overflow above MOMENTS_MAX_KERNEL_ORDER");
+
+        auto ymax = img.size[0];
+        auto xmax = img.size[1];
+
+        for (auto &m_i : m)
+        {
+            for (auto &m_ij : m_i)
+            {
+                m_ij = 0;
+            }
+        }
+
+        for (int y = 0; y < ymax; ++y)
+        {
+            const T *row = img.ptr<T>(y);
+
+            long long row_sums[p + 1] = {};
+            [&]<int... I>(std::integer_sequence<int, I...>)
+            {
+                for (int x = 0; x < xmax; ++x)
+                {
+                    long long xl = x;
+                    ((row_sums[I] += (row[x] == color) ? IntPow<I>(xl) : 0), ...);
+                }
+            }(std::make_integer_sequence<int, p + 1>());
+
+            long long yl = y;
+            for (int i = 0; i <= p; ++i)
+            {
+                long long y_pow = 1;
+                for (int j = 0; j <= q; ++j)
+                {
+                    m[i][j] += row_sums[i] * y_pow;
+                    y_pow *= yl;
+                }
+            }
+        }
+    }
+
+    // Raw moment m_pq of the given color
+    template <int p, int q, typename T>
+    long long Moment(const cv::Mat &img, const T &color)
+    {
+        long long m[p + 1][q + 1];
+        RawMoments<p, q>(img, color, m);
+        return m[p][q];
+    }
+
+    // Centered moment u_pq = sum((x - xt)^p * (y - yt)^q) around the given center
+    template <int p, int q, typename T>
+    double CenteredMoment(const cv::Mat &img, const T &color, const cv::Vec2d &center)
+    {
+        long long m[p + 1][q + 1];
+        RawMoments<p, q>(img, color, m);
+
+        // Binomial expansion: u_pq = sum_i sum_j C(p, i) * C(q, j) * (-xt)^(p - i) * (-yt)^(q - j) * m_ij
+        double sum = 0.0;
+        double binomial_i = 1.0;
+        for (int i = 0; i <= p; ++i)
+        {
+            double binomial_j = 1.0;
+            for (int j = 0; j <= q; ++j)
+            {
+                sum += binomial_i * binomial_j * std::pow(-center[0], p - i) * std::pow(-center[1], q - j) * static_cast<double>(m[i][j]);
+                binomial_j = binomial_j * (q - j) / (j + 1);
+            }
+            binomial_i = binomial_i * (p - i) / (i + 1);
+        }
+
+        return sum;
+    }
+
+    // Centered moment u_pq around the center of mass of the given color.
+    // Second order moments (u20, u11, u02) are computed exactly: u = (m00 * m_pq - m_p0 * m_0q) / m00
+    template <int p, int q, typename T>
+    double CenteredMoment(const cv::Mat &img, const T &color)
+    {
+        if constexpr (p + q == 2)
+        {
+            long long m[p + 1][q + 1];
+            RawMoments<p, q>(img, color, m);
+
+            if (m[0][0] == 0)
+            {
+                return 0.0;
+            }
+
+            // m_p0 * m_0q is m10^2, m10 * m01 or m01^2
+            constexpr int first_i = (p > 0) ? 1 : 0, first_j = 1 - first_i;
+            constexpr int second_j = (q > 0) ? 1 : 0, second_i = 1 - second_j;
+            long long m_first = m[first_i][first_j];
+            long long m_second = m[second_i][second_j];
+
+            return detail::ProductDifference(m[0][0], m[p][q], m_first, m_second) / static_cast<double>(m[0][0]);
+        }
+        else
+        {
+            long long m[2][2];
+            RawMoments<1, 1>(img, color, m);
+
+            if (m[0][0] == 0)
+            {
+                return 0.0;
+            }
+
+            cv::Vec2d center(static_cast<double>(m[1][0]) / m[0][0], static_cast<double>(m[0][1]) / m[0][0]);
+            return CenteredMoment<p, q>(img, color, center);
+        }
+    }
+
+    namespace detail
+    {
+        template <typename T>
+        using MomentKernel = long long (*)(const cv::Mat &, const T &);
+        template <typename T>
+        using CenteredMomentKernel = double (*)(const cv::Mat &, const T &, const cv::Vec2d &);
+
+        // Kernel of m_pq / u_pq, null above p + q == MOMENTS_MAX_KERNEL_ORDER
+        template <int p, int q, typename T>
+        constexpr MomentKernel<T> MomentKernelOrNull()
+        {
+            if constexpr (p + q <= MOMENTS_MAX_KERNEL_ORDER)
+            {
+                return &Moment<p, q, T>;
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+
+        template <int p, int q, typename T>
+        constexpr CenteredMomentKernel<T> CenteredMomentKernelOrNull()
+        {
+            if constexpr (p + q <= MOMENTS_MAX_KERNEL_ORDER)
+            {
+                return &CenteredMoment<p, q, T>;
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+
+        // Tables indexed by p * (MOMENTS_MAX_KERNEL_ORDER + 1) + q
+        template <typename T, int... I>
+        constexpr auto MomentKernels(std::integer_sequence<int, I...>)
+        {
+            return std::array<MomentKernel<T>, sizeof...(I)>{MomentKernelOrNull<I / (MOMENTS_MAX_KERNEL_ORDER + 1), I % (MOMENTS_MAX_KERNEL_ORDER + 1), T>()...};
+        }
+
+        template <typename T, int... I>
+        constexpr auto CenteredMomentKernels(std::integer_sequence<int, I...>)
+        {
+            return std::array<CenteredMomentKernel<T>, sizeof...(I)>{CenteredMomentKernelOrNull<I / (MOMENTS_MAX_KERNEL_ORDER + 1), I % (MOMENTS_MAX_KERNEL_ORDER + 1), T>()...};
+        }
+    }
+
+    // Raw moment m_pq of the given color. Exact up to p + q == MOMENTS_MAX_KERNEL_ORDER,
+    // higher orders are accumulated in double and saturate at the range of long long.
     template <typename T>
-    int Moment(const cv::Mat &img, unsigned char p, unsigned char q, const T &color)
+    long long Moment(const cv::Mat &img, unsigned char p, unsigned char q, const T &color)
     {
         static_assert(std::is_same_v<decltype(color), const unsigned char &>, "color must be unsigned char");
 
+        // Dispatch to the compile time kernel
+        if (p + q <= MOMENTS_MAX_KERNEL_ORDER)
+        {
+            static constexpr auto kernels = detail::MomentKernels<T>(std::make_integer_sequence<int, (MOMENTS_MAX_KERNEL_ORDER + 1) * (MOMENTS_MAX_KERNEL_ORDER + 1)>());
+            return kernels[p * (MOMENTS_MAX_KERNEL_ORDER + 1) + q](img, color);
+        }
+
         auto ymax = img.size[0];
         auto xmax = img.size[1];
 
-        int sum = 0;
+        double sum = 0.0;
         for (int y = 0; y < ymax; ++y)
         {
+            const T *row = img.ptr<T>(y);
             for (int x = 0; x < xmax; ++x)
             {
-                auto val = img.at<T>(y, x);
-                if (img.at<T>(y, x) == color)
+                if (row[x] == color)
                 {
                     sum += std::pow(x, p) * std::pow(y, q);
                 }
             }
         }
 
-        return sum;
+        // 2^63 is exactly representable, every smaller double converts without overflow
+        if (sum >= 0x1p63)
+        {
+            return std::numeric_limits<long long>::max();
+        }
+        return static_cast<long long>(sum);
     }
 
     template <typename T>
     int Area(const cv::Mat &img, const T &color)
     {
-        return Moment<T>(img, 0, 0, color);
+        return static_cast<int>(Moment<0, 0>(img, color));
     }
 
     template <typename T>
@@ -42,12 +302,15 @@ namespace ano
     {
         static_assert(std::is_same_v<decltype(color), const unsigned char &>, "color must be unsigned char");
 
-        auto m00 = Moment<T>(img, 0, 0, color);
-        auto m10 = Moment<T>(img, 1, 0, color);
-        auto m01 = Moment<T>(img, 0, 1, color);
+        long long m[2][2];
+        RawMoments<1, 1>(img, color, m);
+
+        auto m00 = m[0][0];
+        auto m10 = m[1][0];
+        auto m01 = m[0][1];
 
-        auto xt = m10 / m00;
-        auto yt = m01 / m00;
+        auto xt = static_cast<int>(m10 / m00);
+        auto yt = static_cast<int>(m01 / m00);
 
         return {xt, yt};
     }
@@ -80,20 +343,27 @@ namespace ano
     }
 
     template <typename T>
-    int CenteredMoment(const cv::Mat &img, unsigned char p, unsigned char q, const T &color, const cv::Vec2i &center)
+    double CenteredMoment(const cv::Mat &img, unsigned char p, unsigned char q, const T &color, const cv::Vec2i &center)
     {
         static_assert(std::is_same_v<decltype(color), const unsigned char &>, "color must be unsigned char");
 
+        // Dispatch to the compile time kernel, higher orders are accumulated in double
+        if (p + q <= MOMENTS_MAX_KERNEL_ORDER)
+        {
+            static constexpr auto kernels = detail::CenteredMomentKernels<T>(std::make_integer_sequence<int, (MOMENTS_MAX_KERNEL_ORDER + 1) * (MOMENTS_MAX_KERNEL_ORDER + 1)>());
+            return kernels[p * (MOMENTS_MAX_KERNEL_ORDER + 1) + q](img, color, cv::Vec2d(center[0], center[1]));
+        }
+
         auto ymax = img.size[0];
         auto xmax = img.size[1];
 
-        int sum = 0;
-
+        double sum = 0.0;
         for (int y = 0; y < ymax; ++y)
         {
+            const T *row = img.ptr<T>(y);
             for (int x = 0; x < xmax; ++x)
             {
-                if (img.at<T>(y, x) == color)
+                if (row[x] == color)
                 {
                     sum += std::pow(x - center[0], p) * std::pow(y - center[1], q);
                 }
@@ -104,11 +374,115 @@ namespace ano
     }
 
     template <typename T>
-    int CenteredMoment(const cv::Mat &img, unsigned char p, unsigned char q, const T &color)
+    double CenteredMoment(const cv::Mat &img, unsigned char p, unsigned char q, const T &color)
     {
         static_assert(std::is_same_v<decltype(color), const unsigned char &>, "color must be unsigned char");
 
         auto center_of_mass = CenterOfMass(img, color);
         return CenteredMoment(img, p, q, color, center_of_mass);
     }
+
+    // Features of a single object gathered by ComputeMomentFeatures
+    struct MomentFeatures
+    {
+        // Raw moments
+        long long m00 = 0;
+        long long m10 = 0;
+        long long m01 = 0;
+        long long m20 = 0;
+        long long m11 = 0;
+        long long m02 = 0;
+
+        // Centered moments (computed from the raw moments after the pass)
+        double u20 = 0.0;
+        double u11 = 0.0;
+        double u02 = 0.0;
+
+        // Bounding box (inclusive)
+        int x_min = std::numeric_limits<int>::max();
+        int y_min = std::numeric_limits<int>::max();
+        int x_max = std::numeric_limits<int>::min();
+        int y_max = std::numeric_limits<int>::min();
+
+        // Number of pixels with at least one 4-neighbour of a different color (or outside of the image)
+        int circumference = 0;
+
+        bool Empty() const { return m00 == 0; }
+        int Area() const { return static_cast<int>(m00); }
+        cv::Rect BoundingBox() const { return Empty() ? cv::Rect() : cv::Rect(x_min, y_min, x_max - x_min + 1, y_max - y_min + 1); }
+        cv::Vec2i CenterOfMass() const;
+
+        // Compactness: circumference^2 / (100 * area)
+        float F1() const;
+        // Elongation: umin / umax
+        float F2() const;
+    };
+
+    // Table of features indexed by the object color (label)
+    using MomentFeaturesTable = std::vector<MomentFeatures>;
+
+    // Computes centered moments of all non-empty entries from their raw moments
+    void FinalizeMomentFeatures(MomentFeaturesTable &features);
+
+    // Computes moments, bounding box and circumference of every color in [label_min, label_max] in a single pass over the image.
+    // features is resized to label_max + 1 and indexed by the color. Colors outside of the range are ignored.
+    template <typename T>
+    void ComputeMomentFeatures(const cv::Mat &img, int label_min, int label_max, MomentFeaturesTable &features)
+    {
+        static_assert(std::is_integral_v<T>, "labels must be integral");
+
+        auto ymax = img.size[0];
+        auto xmax = img.size[1];
+
+        features.assign(std::max(label_max + 1, 0), MomentFeatures());
+
+        for (int y = 0; y < ymax; ++y)
+        {
+            const T *row = img.ptr<T>(y);
+            const T *row_up = (y > 0) ? img.ptr<T>(y - 1) : nullptr;
+            const T *row_down = (y < ymax - 1) ? img.ptr<T>(y + 1) : nullptr;
+
+            for (int x = 0; x < xmax; ++x)
+            {
+                int label = row[x];
+                if (label < label_min || label > label_max)
+                {
+                    continue;
+                }
+
+                auto &f = features[label];
+                long long xl = x, yl = y;
+
+                f.m00++;
+                f.m10 += xl;
+                f.m01 += yl;
+                f.m20 += xl * xl;
+                f.m11 += xl * yl;
+                f.m02 += yl * yl;
+
+                f.x_min = std::min(f.x_min, x);
+                f.y_min = std::min(f.y_min, y);
+                f.x_max = std::max(f.x_max, x);
+                f.y_max = std::max(f.y_max, y);
+
+                // If any of the surrounding pixels is not the same color, add 1 to circumference
+                bool inner = row_up && row_down && x > 0 && x < xmax - 1 &&
+                             row_up[x] == row[x] && row[x - 1] == row[x] && row[x + 1] == row[x] && row_down[x] == row[x];
+                if (!inner)
+                {
+                    f.circumference++;
+                }
+            }
+        }
+
+        FinalizeMomentFeatures(features);
+    }
+
+    template <typename T>
+    MomentFeaturesTable ComputeMomentFeatures(const cv::Mat &img, int label_min, int label_max)
+    {
+        MomentFeaturesTable features;
+        ComputeMomentFeatures<T>(img, label_min, label_max, features);
+        return features;
+    }
 }
\ No newline at end of file
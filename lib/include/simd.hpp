@@ -0,0 +1,21 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+// ano-lib is compiled for the baseline instruction set. Kernels with an AVX2/FMA code path compile it with
+// ANO_AVX2_TARGET (a function level target, only when lib/CMakeLists.txt defines ANO_ENABLE_AVX2) and call it
+// only when HasAVX2() -> the same binary runs on CPUs without AVX2.
+#if defined(ANO_ENABLE_AVX2)
+#include <immintrin.h>
+#define ANO_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+namespace ano
+{
+    // True when the CPU running the program supports AVX2 and FMA (checked once)
+    inline bool HasAVX2()
+    {
+        static const bool supported = cv::checkHardwareSupport(CV_CPU_AVX2) && cv::checkHardwareSupport(CV_CPU_FMA3);
+        return supported;
+    }
+}
\ No newline at end of file
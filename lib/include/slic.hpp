@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include <opencv2/opencv.hpp>
 
 namespace ano
@@ -7,5 +9,107 @@ namespace ano
 #define SLIC_CENTROID_COLOR (cv::Vec3b(0, 0, 255))
 #define SLIC_CENTROID_STARTING_COLOR (cv::Vec3b(255, 0, 0))
 
-    cv::Mat SLIC(const cv::Mat &img, int k_segments, float m_balance = 1.0f, int max_iterations = 1000, bool debug_view = false);
-}
+    // SLIC flags
+    // Assign and update steps run on horizontal bands of rows on separate threads (same result as the sequential version)
+#define SLIC_PARALLEL (1 << 0)
+    // Color distance is measured in CIELAB instead of BGR. The image is converted once before the iterations.
+    // m_balance is relative to the Lab ranges (L 0 to 100), the SLIC paper suggests 1 to 40.
+#define SLIC_LAB (1 << 1)
+    // Coarse to fine: SLIC runs on a pyramid of 2x downscaled images first and every finer level starts from the upsampled labels
+    // of the coarser one with at most SLIC_PYRAMID_REFINE_ITERATIONS iterations. Only the coarsest level runs max_iterations.
+#define SLIC_PYRAMID (1 << 2)
+
+    // Smallest grid step S of the coarsest pyramid level
+#define SLIC_PYRAMID_MIN_GRID_STEP (8)
+    // Iterations of every pyramid level finer than the coarsest one
+#define SLIC_PYRAMID_REFINE_ITERATIONS (3)
+
+    // Minimal number of rows of a band processed by a single thread with SLIC_PARALLEL
+#define SLIC_MIN_BAND_HEIGHT (16)
+
+    // SLIC superpixels. Returns the image painted with the superpixel colors and the centroids drawn on it.
+    // flags - combination of the SLIC_* flags above
+    cv::Mat SLIC(const cv::Mat &img, int k_segments, float m_balance = 1.0f, int max_iterations = 1000, bool debug_view = false, int flags = 0);
+
+    // Statistics of a single superpixel
+    struct SLICSuperpixel
+    {
+        int count = 0;         // Pixel count, 0 = the centroid lost all its pixels
+        cv::Vec3f mean_color;  // Mean color (BGR, Lab with SLIC_LAB)
+        cv::Point2f centroid;  // Mean position
+        cv::Rect bounding_box; // Smallest rectangle containing the pixels
+    };
+
+    using SLICSuperpixels = std::vector<SLICSuperpixel>;
+
+    // Same segmentation as SLIC, but instead of painting a copy of the image it returns the label map (CV_32SC1, index into
+    // superpixels of every pixel) and the statistics of every superpixel, taken from the sums of the last update step.
+    // Pixels outside the search windows of all centroids are assigned to the nearest centroid, so no label is -1.
+    void SLICLabels(const cv::Mat &img, cv::Mat &labels, SLICSuperpixels &superpixels, int k_segments, float m_balance = 1.0f, int max_iterations = 1000, int flags = 0);
+
+    // Default number of iterations TemporalSLIC runs on the frames following the first one
+#define SLIC_TEMPORAL_REFINE_ITERATIONS (2)
+
+    // Centroids as a structure of arrays: centroid i is at (x[i], y[i]) and has color (c0[i], c1[i], c2[i]) in BGR or Lab
+    struct SLICCentroids
+    {
+        std::vector<float> x, y;
+        std::vector<float> c0, c1, c2;
+
+        int Size() const { return static_cast<int>(x.size()); }
+
+        void Add(float centroid_x, float centroid_y, float color0, float color1, float color2)
+        {
+            x.push_back(centroid_x);
+            y.push_back(centroid_y);
+            c0.push_back(color0);
+            c1.push_back(color1);
+            c2.push_back(color2);
+        }
+
+        void Clear()
+        {
+            x.clear();
+            y.clear();
+            c0.clear();
+            c1.clear();
+            c2.clear();
+        }
+    };
+
+    // SLIC for video streams. Keeps the centroids and the label map of the previous frame and starts the next frame from them,
+    // so frames of a static camera need only a few refinement iterations instead of a full SLIC from a grid.
+    // All buffers are reused between frames.
+    class TemporalSLIC
+    {
+    public:
+        // flags - combination of the SLIC_* flags (SLIC_PYRAMID only affects frames starting from scratch)
+        // refine_iterations - maximal number of iterations of the frames following the first one
+        // max_iterations - maximal number of iterations of the first frame
+        TemporalSLIC(int k_segments, float m_balance = 1.0f, int flags = 0, int refine_iterations = SLIC_TEMPORAL_REFINE_ITERATIONS, int max_iterations = 1000);
+
+        // Segments a CV_8UC3 frame and returns its label map (CV_32SC1, centroid index of every pixel, never -1).
+        // The first frame, the first frame after Reset and frames of a different size start from a grid.
+        const cv::Mat &Process(const cv::Mat &frame);
+        // The next frame starts from a grid (e.g. after a scene cut)
+        void Reset();
+
+        const cv::Mat &Labels() const { return labels; }
+        const SLICCentroids &Centroids() const { return centroids; }
+        // Paints the last frame with the superpixel colors (BGR)
+        void Paint(cv::Mat &img_out) const;
+
+    private:
+        int k_segments;
+        float m_balance;
+        int flags;
+        int refine_iterations;
+        int max_iterations;
+
+        bool initialized = false;
+        SLICCentroids centroids;
+        cv::Mat planes[3];
+        cv::Mat labels;
+        cv::Mat distances;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+namespace ano
+{
+    // Assumed size of a cache line. Head and tail are kept on separate lines so the producer and the consumer do not
+    // invalidate each other's cache on every operation.
+#define SPSC_QUEUE_CACHE_LINE (64)
+
+    // Number of retries of a blocking Pop on an empty queue before the consumer goes to sleep
+#define SPSC_QUEUE_SPIN_COUNT (64)
+
+    // Bounded lock-free queue for exactly one producer thread and one consumer thread.
+    // Storage is allocated once in the constructor. Capacity is rounded up to a power of two.
+    template <typename T>
+    class SPSCQueue
+    {
+    public:
+        explicit SPSCQueue(size_t capacity)
+        {
+            size_t size = 1;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+
+            items.resize(size);
+            mask = size - 1;
+        }
+
+        SPSCQueue(const SPSCQueue &) = delete;
+        SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+        size_t Capacity() const { return items.size(); }
+
+        // Producer only. Returns false when the queue is full.
+        bool TryPush(const T &item)
+        {
+            const size_t tail_local = tail.load(std::memory_order_relaxed);
+            if (tail_local - head_cached == items.size())
+            {
+                head_cached = head.load(std::memory_order_acquire);
+                if (tail_local - head_cached == items.size())
+                {
+                    return false;
+                }
+            }
+
+            items[tail_local & mask] = item;
+            tail.store(tail_local + 1, std::memory_order_release);
+
+            // Wakes the consumer when it sleeps in Pop
+            tail.notify_one();
+            return true;
+        }
+
+        // Consumer only. Returns false when the queue is empty.
+        bool TryPop(T &item)
+        {
+            const size_t head_local = head.load(std::memory_order_relaxed);
+            if (head_local == tail_cached)
+            {
+                tail_cached = tail.load(std::memory_order_acquire);
+                if (head_local == tail_cached)
+                {
+                    return false;
+                }
+            }
+
+            item = items[head_local & mask];
+            head.store(head_local + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only. Waits for an item: retries SPSC_QUEUE_SPIN_COUNT times, then sleeps until the producer pushes one.
+        void Pop(T &item)
+        {
+            for (int spin = 0; !TryPop(item); spin++)
+            {
+                if (spin < SPSC_QUEUE_SPIN_COUNT)
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    // The queue is empty -> tail equals head until the next push
+                    tail.wait(head.load(std::memory_order_relaxed), std::memory_order_acquire);
+                }
+            }
+        }
+
+        // Approximate when called concurrently with the other thread
+        bool Empty() const
+        {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::vector<T> items;
+        size_t mask = 0;
+
+        // Written by the consumer
+        alignas(SPSC_QUEUE_CACHE_LINE) std::atomic<size_t> head = 0;
+        size_t tail_cached = 0;
+
+        // Written by the producer
+        alignas(SPSC_QUEUE_CACHE_LINE) std::atomic<size_t> tail = 0;
+        size_t head_cached = 0;
+    };
+}
\ No newline at end of file
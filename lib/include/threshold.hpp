@@ -0,0 +1,23 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+namespace ano
+{
+    // All functions take a CV_8UC1 image and (re)allocate img_threshold as CV_8UC1 with 255 = foreground, 0 = background.
+
+    // Binary threshold: 255 where img > threshold
+    void Threshold(const cv::Mat &img, cv::Mat &img_threshold, unsigned char threshold);
+
+    // Inverse binary threshold: 255 where img <= threshold
+    void ThresholdInverse(const cv::Mat &img, cv::Mat &img_threshold, unsigned char threshold);
+
+    // Range threshold: 255 where low <= img <= high
+    void ThresholdRange(const cv::Mat &img, cv::Mat &img_threshold, unsigned char low, unsigned char high);
+
+    // Finds the threshold maximizing the between-class variance of the image histogram (Otsu's method)
+    unsigned char OtsuThreshold(const cv::Mat &img);
+
+    // Binary threshold with the threshold found by OtsuThreshold. Returns the threshold.
+    unsigned char ThresholdOtsu(const cv::Mat &img, cv::Mat &img_threshold);
+}
\ No newline at end of file
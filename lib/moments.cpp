@@ -0,0 +1,47 @@
+#include "moments.hpp"
+
+#include <cmath>
+
+namespace ano
+{
+    cv::Vec2i MomentFeatures::CenterOfMass() const
+    {
+        if (Empty())
+        {
+            return {0, 0};
+        }
+
+        return {static_cast<int>(m10 / m00), static_cast<int>(m01 / m00)};
+    }
+
+    float MomentFeatures::F1() const
+    {
+        return std::pow(circumference, 2) / (100.0f * Area());
+    }
+
+    float MomentFeatures::F2() const
+    {
+        auto root = std::sqrt(4 * u11 * u11 + (u20 - u02) * (u20 - u02));
+        auto umax = 0.5 * (u20 + u02) + 0.5 * root;
+        auto umin = 0.5 * (u20 + u02) - 0.5 * root;
+
+        return static_cast<float>(umin / umax);
+    }
+
+    void FinalizeMomentFeatures(MomentFeaturesTable &features)
+    {
+        for (auto &f : features)
+        {
+            if (f.Empty())
+            {
+                continue;
+            }
+
+            // u_pq from raw moments: u20 = m20 - m10^2 / m00, u11 = m11 - m10 * m01 / m00, u02 = m02 - m01^2 / m00
+            double m00 = static_cast<double>(f.m00);
+            f.u20 = f.m20 - f.m10 * static_cast<double>(f.m10) / m00;
+            f.u11 = f.m11 - f.m10 * static_cast<double>(f.m01) / m00;
+            f.u02 = f.m02 - f.m01 * static_cast<double>(f.m01) / m00;
+        }
+    }
+}
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <vector>
 
 #include "image-gradient.hpp"
 
@@ -11,29 +15,139 @@ namespace ano
 
 #define SLIC_CENTEROIDS_MOVED_THRESHOLD (1e-4)
 
-    // SLIC: Simple Linear Iterative Clustering
-    cv::Mat SLIC(const cv::Mat &img, int k_segments, float m_balance, int max_iterations, bool debug_view)
+    // Splits a CV_8UC3 image into 3 CV_32FC1 planes, so the assignment step reads every channel with unit stride
+    static void SLICSplitColor(const cv::Mat &img, cv::Mat (&planes)[3])
     {
-        auto w = img.size[1];
-        auto h = img.size[0];
-        auto pixel_count = w * h;
+        assert(img.type() == CV_8UC3);
 
-        auto S = std::sqrt(pixel_count / k_segments);
-        auto x_count = std::floor(w / S);
-        auto y_count = std::floor(h / S);
+        for (auto &plane : planes)
+        {
+            plane.create(img.size(), CV_32FC1);
+        }
 
-        // SLIC: S is not an integer multiple of the image size
-        // assert(S == x_count * y_count);
+        for (int y = 0; y < img.size[0]; y++)
+        {
+            const unsigned char *row = img.ptr<unsigned char>(y);
+            float *row0 = planes[0].ptr<float>(y);
+            float *row1 = planes[1].ptr<float>(y);
+            float *row2 = planes[2].ptr<float>(y);
 
-        // Copy of input image
-        cv::Mat img_slic = img.clone();
-        // Distance + index
-        cv::Mat img_slic_indices(img_slic.size(), CV_32FC2);
+            for (int x = 0; x < img.size[1]; x++)
+            {
+                row0[x] = row[3 * x];
+                row1[x] = row[3 * x + 1];
+                row2[x] = row[3 * x + 2];
+            }
+        }
+    }
+
+    // sRGB (D65) <-> CIE XYZ matrices and the reference white
+    static constexpr float slic_rgb_to_xyz[3][3] = {{0.412453f, 0.357580f, 0.180423f},
+                                                    {0.212671f, 0.715160f, 0.072169f},
+                                                    {0.019334f, 0.119193f, 0.950227f}};
+    static constexpr float slic_xyz_to_rgb[3][3] = {{3.240479f, -1.537150f, -0.498535f},
+                                                    {-0.969256f, 1.875991f, 0.041556f},
+                                                    {0.055648f, -0.204043f, 1.057311f}};
+    static constexpr float slic_white_x = 0.950456f;
+    static constexpr float slic_white_z = 1.088754f;
+
+    // CIELAB companding function f(t)
+    static inline float SLICLabF(float t)
+    {
+        return (t > 0.008856f) ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+    }
+
+    // Converts a CV_8UC3 BGR image to 3 CV_32FC1 planes L (0 to 100), a, b in a single pass.
+    // The sRGB gamma curve is looked up from a table of all 256 values, only the cube root is computed per pixel.
+    static void SLICSplitLab(const cv::Mat &img, cv::Mat (&planes)[3])
+    {
+        assert(img.type() == CV_8UC3);
+
+        static const auto gamma_lut = []()
+        {
+            std::array<float, 256> lut;
+            for (int i = 0; i < 256; i++)
+            {
+                float v = i / 255.0f;
+                lut[i] = (v <= 0.04045f) ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+            }
+            return lut;
+        }();
+
+        for (auto &plane : planes)
+        {
+            plane.create(img.size(), CV_32FC1);
+        }
+
+        for (int y = 0; y < img.size[0]; y++)
+        {
+            const unsigned char *row = img.ptr<unsigned char>(y);
+            float *row_l = planes[0].ptr<float>(y);
+            float *row_a = planes[1].ptr<float>(y);
+            float *row_b = planes[2].ptr<float>(y);
+
+            for (int x = 0; x < img.size[1]; x++)
+            {
+                const float b = gamma_lut[row[3 * x]];
+                const float g = gamma_lut[row[3 * x + 1]];
+                const float r = gamma_lut[row[3 * x + 2]];
+
+                const float fx = SLICLabF((slic_rgb_to_xyz[0][0] * r + slic_rgb_to_xyz[0][1] * g + slic_rgb_to_xyz[0][2] * b) / slic_white_x);
+                const float fy = SLICLabF(slic_rgb_to_xyz[1][0] * r + slic_rgb_to_xyz[1][1] * g + slic_rgb_to_xyz[1][2] * b);
+                const float fz = SLICLabF((slic_rgb_to_xyz[2][0] * r + slic_rgb_to_xyz[2][1] * g + slic_rgb_to_xyz[2][2] * b) / slic_white_z);
 
-        const float color_space_distance_balance = m_balance / S;
+                row_l[x] = 116.0f * fy - 16.0f;
+                row_a[x] = 500.0f * (fx - fy);
+                row_b[x] = 200.0f * (fy - fz);
+            }
+        }
+    }
+
+    // Color planes of the image in BGR or Lab
+    static void SLICSplit(const cv::Mat &img, cv::Mat (&planes)[3], bool lab)
+    {
+        if (lab)
+        {
+            SLICSplitLab(img, planes);
+        }
+        else
+        {
+            SLICSplitColor(img, planes);
+        }
+    }
+
+    // Converts a single Lab color back to BGR
+    static cv::Vec3b SLICLabToBGR(float l, float a, float b)
+    {
+        auto f_inverse = [](float t)
+        {
+            return (t > 6.0f / 29.0f) ? t * t * t : 3.0f * (6.0f / 29.0f) * (6.0f / 29.0f) * (t - 4.0f / 29.0f);
+        };
+
+        const float fy = (l + 16.0f) / 116.0f;
+        const float xyz[3] = {slic_white_x * f_inverse(fy + a / 500.0f), f_inverse(fy), slic_white_z * f_inverse(fy - b / 200.0f)};
+
+        cv::Vec3b bgr;
+        for (int i = 0; i < 3; i++)
+        {
+            float v = slic_xyz_to_rgb[i][0] * xyz[0] + slic_xyz_to_rgb[i][1] * xyz[1] + slic_xyz_to_rgb[i][2] * xyz[2];
+            v = (v <= 0.0031308f) ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+            bgr[2 - i] = static_cast<unsigned char>(std::clamp(v * 255.0f + 0.5f, 0.0f, 255.0f));
+        }
+        return bgr;
+    }
+
+    // Step 0: Initialize centroids on a grid with step S, each moved to the lowest gradient position in its 3x3 neighbourhood
+    static void SLICSeedCentroids(const cv::Mat &img, const cv::Mat (&planes)[3], float S, SLICCentroids &centroids, bool parallel)
+    {
+        auto w = img.size[1];
+        auto h = img.size[0];
+        auto x_count = static_cast<int>(std::floor(w / S));
+        auto y_count = static_cast<int>(std::floor(h / S));
+
+        // One greyscale conversion and gradient pass for all the seeds
+        auto gradients = ano::ComputeGradients(img, parallel ? GRADIENT_PARALLEL : 0);
 
-        // Step 0: Initialize centroids as a pair of color and (x, y) coordinates
-        std::vector<std::pair<cv::Vec2f, cv::Vec3b>> centroids;
         auto S_offset = S / 2;
         for (int y = 0; y < y_count; ++y)
         {
@@ -45,218 +159,615 @@ namespace ano
                 assert(x_center - 1 >= 0 && y_center - 1 >= 0);
                 assert(x_center + 1 < w && y_center + 1 < h);
 
-                // using gradient_type = float[2];
-                using gradient_type = cv::Vec2f;
-
-                auto gradient = ano::ComputeGradients(img_slic, x_center - 1, y_center - 1, 3, 3);
-                assert(gradient.isContinuous());
-
-                // Find the gradient with the smallest magnitude
-                auto mat_begin_ptr = reinterpret_cast<gradient_type *>(gradient.ptr(0));
-                auto mat_end_ptr = reinterpret_cast<gradient_type *>(gradient.ptr(3));
-                auto min_ptr = std::min_element(mat_begin_ptr, mat_end_ptr, [](const gradient_type &a, const gradient_type &b)
-                                                {
-                                                    return a[1] < b[1]; // Compare gradient magnitudes
-                                                });
-
-                // Find the index of the gradient with the smallest magnitude
-                int min_index = static_cast<int>(std::distance(mat_begin_ptr, min_ptr));
-                auto min_index_x = min_index % 3;
-                auto min_index_y = min_index / 3;
-
-                assert(min_index_x < 3 && min_index_x < 3);
+                // Find the gradient with the smallest magnitude in the 3x3 neighbourhood
+                auto min_index_x = 0, min_index_y = 0;
+                auto min_magnitude = std::numeric_limits<float>::max();
+                for (int dy = 0; dy < 3; dy++)
+                {
+                    const cv::Vec2f *gradients_row = gradients.ptr<cv::Vec2f>(y_center - 1 + dy) + (x_center - 1);
+                    for (int dx = 0; dx < 3; dx++)
+                    {
+                        if (gradients_row[dx][1] < min_magnitude) // Compare gradient magnitudes
+                        {
+                            min_magnitude = gradients_row[dx][1];
+                            min_index_x = dx;
+                            min_index_y = dy;
+                        }
+                    }
+                }
 
                 auto centroid_x = x_center - 1 + min_index_x;
                 auto centroid_y = y_center - 1 + min_index_y;
 
-                // Add the centroid to the list
-                centroids.push_back({cv::Vec2f(centroid_x, centroid_y), img.at<cv::Vec3b>(centroid_y, centroid_y)});
+                // Add the centroid with the color of its pixel
+                centroids.Add(centroid_x, centroid_y,
+                              planes[0].at<float>(centroid_y, centroid_x),
+                              planes[1].at<float>(centroid_y, centroid_x),
+                              planes[2].at<float>(centroid_y, centroid_x));
             }
         }
+    }
 
-        auto starting_centroids = centroids;
+    // Step 1: Assign each pixel in rows [y_begin, y_end) to its closest centroid
+    // Every centroid searches its -S to +S (== 2S x 2S) window. Distances are squared: D^2 = dc^2 + spatial_weight * ds^2.
+    // labels keep the previous assignment of pixels no window reaches. Centroids are visited in index order, so any split of
+    // the rows gives the same labels.
+    static void SLICAssign(const cv::Mat (&planes)[3], const SLICCentroids &centroids, float S, float spatial_weight, cv::Mat &labels, cv::Mat &distances, int y_begin, int y_end)
+    {
+        auto w = planes[0].size[1];
 
-        int iterations = 0;
-        bool centroids_moved = true;
-        while (centroids_moved && iterations < max_iterations)
+        for (int y = y_begin; y < y_end; y++)
         {
-            centroids_moved = false;
+            std::fill_n(distances.ptr<float>(y), w, std::numeric_limits<float>::max());
+        }
 
-            // Step 1: Assign each pixel to its closest centroid
-            // Zero the distance and indices for all pixels
-            for (int y = 0; y < img_slic_indices.size[0]; y++)
+        for (int i = 0; i < centroids.Size(); i++)
+        {
+            const float centroid_x = centroids.x[i];
+            const float centroid_y = centroids.y[i];
+            const float color0 = centroids.c0[i];
+            const float color1 = centroids.c1[i];
+            const float color2 = centroids.c2[i];
+
+            // Window of the centroid clipped to the image
+            const int x_min = std::max(static_cast<int>(centroid_x - S), 0);
+            const int x_max = std::min(static_cast<int>(centroid_x + S), w);
+            const int y_min = std::max(static_cast<int>(centroid_y - S), y_begin);
+            const int y_max = std::min(static_cast<int>(centroid_y + S), y_end);
+
+            for (int y = y_min; y < y_max; y++)
             {
-                for (int x = 0; x < img_slic_indices.size[1]; x++)
+                const float *row0 = planes[0].ptr<float>(y);
+                const float *row1 = planes[1].ptr<float>(y);
+                const float *row2 = planes[2].ptr<float>(y);
+                float *row_distances = distances.ptr<float>(y);
+                int *row_labels = labels.ptr<int>(y);
+
+                const float dy = y - centroid_y;
+                const float distance_y = spatial_weight * dy * dy;
+
+                // Branchless body -> vectorized by the compiler
+                for (int x = x_min; x < x_max; x++)
                 {
-                    img_slic_indices.at<cv::Vec2f>(y, x) = {std::numeric_limits<float>::max(), 0.0f};
+                    const float d0 = row0[x] - color0;
+                    const float d1 = row1[x] - color1;
+                    const float d2 = row2[x] - color2;
+                    const float dx = x - centroid_x;
+
+                    const float distance = d0 * d0 + d1 * d1 + d2 * d2 + spatial_weight * dx * dx + distance_y;
+                    const bool closer = distance < row_distances[x];
+
+                    row_distances[x] = closer ? distance : row_distances[x];
+                    row_labels[x] = closer ? i : row_labels[x];
                 }
             }
+        }
+    }
+
+    // Per centroid sums of the coordinates and colors of its pixels
+    // Optionally also the bounding boxes (x_min, y_min, x_max, y_max) of the pixels
+    struct SLICSums
+    {
+        std::vector<double> x, y;
+        std::vector<double> c0, c1, c2;
+        std::vector<int> counts;
+        std::vector<cv::Vec4i> bounds;
+
+        void Reset(int size, bool with_bounds = false)
+        {
+            x.assign(size, 0.0);
+            y.assign(size, 0.0);
+            c0.assign(size, 0.0);
+            c1.assign(size, 0.0);
+            c2.assign(size, 0.0);
+            counts.assign(size, 0);
+            bounds.assign(with_bounds ? size : 0, cv::Vec4i(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), -1, -1));
+        }
 
-            // For every center search in -S to +S (== 2S x 2S) square and assign the pixel to the closest centroid
-            for (int i = 0; const auto &centroid : centroids)
+        void Add(const SLICSums &other)
+        {
+            for (size_t i = 0; i < counts.size(); i++)
             {
-                const auto &centroid_x = centroid.first[0];
-                const auto &centroid_y = centroid.first[1];
-                const auto &centroid_color = centroid.second;
+                x[i] += other.x[i];
+                y[i] += other.y[i];
+                c0[i] += other.c0[i];
+                c1[i] += other.c1[i];
+                c2[i] += other.c2[i];
+                counts[i] += other.counts[i];
+            }
 
-                auto y_max = std::min(static_cast<int>(centroid_y + S), h);
-                for (int y = std::max(static_cast<int>(centroid_y - S), 0); y < y_max; y++)
-                {
-                    auto x_max = std::min(static_cast<int>(centroid_x + S), w);
-                    for (int x = std::max(static_cast<int>(centroid_x - S), 0); x < x_max; x++)
-                    {
-                        assert(x >= 0 && y >= 0 && x < w && y < h);
+            for (size_t i = 0; i < bounds.size(); i++)
+            {
+                bounds[i][0] = std::min(bounds[i][0], other.bounds[i][0]);
+                bounds[i][1] = std::min(bounds[i][1], other.bounds[i][1]);
+                bounds[i][2] = std::max(bounds[i][2], other.bounds[i][2]);
+                bounds[i][3] = std::max(bounds[i][3], other.bounds[i][3]);
+            }
+        }
+    };
 
-                        auto &distance = img_slic_indices.at<cv::Vec2f>(y, x)[0];
-                        auto &centroid_idx = img_slic_indices.at<cv::Vec2f>(y, x)[1];
-                        const auto &pixel_color = img_slic.at<cv::Vec3b>(y, x);
+    // Step 2a: Add pixels of rows [y_begin, y_end) to the sums of their centroids
+    // with_bounds -> also updates sums.bounds, once per run of equal labels in a row
+    template <bool with_bounds>
+    static void SLICAccumulate(const cv::Mat (&planes)[3], const cv::Mat &labels, SLICSums &sums, int y_begin, int y_end)
+    {
+        const int w = labels.size[1];
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            const int *row_labels = labels.ptr<int>(y);
+            const float *row0 = planes[0].ptr<float>(y);
+            const float *row1 = planes[1].ptr<float>(y);
+            const float *row2 = planes[2].ptr<float>(y);
 
-                        auto new_xy_distance = ano::EuclidianDistance(centroid_x, x, centroid_y, y);
-                        auto new_color_distance = ano::DiffColor(centroid_color, pixel_color);
-                        auto new_distance = new_color_distance + color_space_distance_balance * new_xy_distance;
+            for (int x = 0; x < w; ++x)
+            {
+                const int centroid_idx = row_labels[x];
+                if (centroid_idx < 0)
+                {
+                    continue;
+                }
 
-                        if (new_distance < distance)
-                        {
-                            distance = new_distance;
-                            centroid_idx = i;
-                        }
+                if constexpr (with_bounds)
+                {
+                    auto &bounds = sums.bounds[centroid_idx];
+                    if (x == 0 || row_labels[x - 1] != centroid_idx)
+                    {
+                        bounds[0] = std::min(bounds[0], x);
+                        bounds[1] = std::min(bounds[1], y);
+                        bounds[3] = std::max(bounds[3], y);
+                    }
+                    if (x + 1 == w || row_labels[x + 1] != centroid_idx)
+                    {
+                        bounds[2] = std::max(bounds[2], x);
                     }
                 }
 
-                // Increment centroid index
-                i++;
+                // Add the pixel to the sum of its coresponding centroid
+                sums.x[centroid_idx] += x;
+                sums.y[centroid_idx] += y;
+                sums.c0[centroid_idx] += row0[x];
+                sums.c1[centroid_idx] += row1[x];
+                sums.c2[centroid_idx] += row2[x];
+                sums.counts[centroid_idx]++;
             }
+        }
+    }
+
+    // Step 2b: Update centroids as centers of their assigned pixels. Returns true when any of them moved.
+    static bool SLICUpdate(const SLICSums &sums, const cv::Size &size, SLICCentroids &centroids)
+    {
+        // Divide all sums by their pixel counts
+        bool centroids_moved = false;
+        for (int i = 0; i < centroids.Size(); ++i)
+        {
+            const int count = sums.counts[i];
+            if (count == 0)
+            {
+                continue;
+            }
+
+            auto new_centroid_x = static_cast<float>(sums.x[i] / count);
+            auto new_centroid_y = static_cast<float>(sums.y[i] / count);
 
-            // Step 2: Update centroids
+            assert(new_centroid_x >= 0 && new_centroid_x < size.width && new_centroid_y >= 0 && new_centroid_y < size.height);
 
-            // Go through all centroids and calculate their new position as centers of their assigned pixels
-            auto size = centroids.size();
-            if (size > std::numeric_limits<double>::max())
+            // Check if the centroid has moved more than a threshold
+            if (std::abs(new_centroid_x - centroids.x[i]) > SLIC_CENTEROIDS_MOVED_THRESHOLD ||
+                std::abs(new_centroid_y - centroids.y[i]) > SLIC_CENTEROIDS_MOVED_THRESHOLD)
             {
-                throw std::overflow_error("size is larger than DOUBLE_MAX");
+                centroids_moved = true;
             }
-            auto centroids_count = static_cast<double>(size);
 
-            std::vector<int> counts = std::vector<int>(centroids.size(), 0);
-            std::vector<cv::Vec6d> sums_x_y_b_g_r = std::vector<cv::Vec6d>(centroids_count, cv::Vec6d(0.0, 0.0));
-            for (int y = 0; y < img_slic_indices.size[0]; ++y)
+            // Update the centroid centers and colors
+            centroids.x[i] = new_centroid_x;
+            centroids.y[i] = new_centroid_y;
+            centroids.c0[i] = static_cast<float>(sums.c0[i] / count);
+            centroids.c1[i] = static_cast<float>(sums.c1[i] / count);
+            centroids.c2[i] = static_cast<float>(sums.c2[i] / count);
+        }
+
+        return centroids_moved;
+    }
+
+    // One assign + update iteration. Returns true when any centroid moved.
+    // assign == false -> only updates the centroids from the current labels (e.g. colors of a new frame)
+    // stats -> receives the sums (with bounds) the centroids were updated from
+    // parallel -> the rows are split into bands processed on separate threads. Every band assigns its own rows (no
+    // conflicting writes) and accumulates into its own partial sums, which are reduced in band order at the end.
+    static bool SLICIterate(const cv::Mat (&planes)[3], SLICCentroids &centroids, float S, float spatial_weight, cv::Mat &labels, cv::Mat &distances, bool parallel, bool assign = true, SLICSums *stats = nullptr)
+    {
+        auto accumulate = (stats != nullptr) ? SLICAccumulate<true> : SLICAccumulate<false>;
+
+        const int h = labels.size[0];
+        const int band_count = parallel ? std::clamp(h / SLIC_MIN_BAND_HEIGHT, 1, cv::getNumThreads()) : 1;
+
+        thread_local std::vector<SLICSums> band_sums;
+        auto &sums = band_sums;
+        sums.resize(band_count);
+
+        if (band_count == 1)
+        {
+            if (assign)
             {
-                for (int x = 0; x < img_slic_indices.size[1]; ++x)
+                SLICAssign(planes, centroids, S, spatial_weight, labels, distances, 0, h);
+            }
+            sums[0].Reset(centroids.Size(), stats != nullptr);
+            accumulate(planes, labels, sums[0], 0, h);
+        }
+        else
+        {
+            cv::parallel_for_(cv::Range(0, band_count), [&](const cv::Range &range)
+                              {
+                                  for (int band = range.start; band < range.end; band++)
+                                  {
+                                      const int y_begin = static_cast<int>(static_cast<long long>(h) * band / band_count);
+                                      const int y_end = static_cast<int>(static_cast<long long>(h) * (band + 1) / band_count);
+
+                                      if (assign)
+                                      {
+                                          SLICAssign(planes, centroids, S, spatial_weight, labels, distances, y_begin, y_end);
+                                      }
+                                      sums[band].Reset(centroids.Size(), stats != nullptr);
+                                      accumulate(planes, labels, sums[band], y_begin, y_end);
+                                  } });
+
+            for (int band = 1; band < band_count; band++)
+            {
+                sums[0].Add(sums[band]);
+            }
+        }
+
+        if (stats != nullptr)
+        {
+            *stats = sums[0];
+        }
+
+        return SLICUpdate(sums[0], labels.size(), centroids);
+    }
+
+    // BGR colors of all centroids
+    static std::vector<cv::Vec3b> SLICCentroidColors(const SLICCentroids &centroids, bool lab)
+    {
+        std::vector<cv::Vec3b> colors(centroids.Size());
+        for (int i = 0; i < centroids.Size(); i++)
+        {
+            colors[i] = lab ? SLICLabToBGR(centroids.c0[i], centroids.c1[i], centroids.c2[i])
+                            : cv::Vec3b{static_cast<unsigned char>(centroids.c0[i]), static_cast<unsigned char>(centroids.c1[i]), static_cast<unsigned char>(centroids.c2[i])};
+        }
+        return colors;
+    }
+
+    // Draws centroid colors to their pixels. Pixels without a centroid keep their color.
+    static void SLICPaint(const std::vector<cv::Vec3b> &colors, const cv::Mat &labels, cv::Mat &img_out)
+    {
+        for (int y = 0; y < img_out.size[0]; ++y)
+        {
+            const int *row_labels = labels.ptr<int>(y);
+            cv::Vec3b *row_out = img_out.ptr<cv::Vec3b>(y);
+
+            for (int x = 0; x < img_out.size[1]; x++)
+            {
+                if (row_labels[x] >= 0)
                 {
-                    auto centroid_idx = static_cast<int>(img_slic_indices.at<cv::Vec2f>(y, x)[1]);
-                    auto pixel = img_slic.at<cv::Vec3b>(y, x);
-
-                    // Add the pixel to the sum of its coresponding centroid
-                    sums_x_y_b_g_r[centroid_idx][0] += x;
-                    sums_x_y_b_g_r[centroid_idx][1] += y;
-                    sums_x_y_b_g_r[centroid_idx][2] += pixel[0];
-                    sums_x_y_b_g_r[centroid_idx][3] += pixel[1];
-                    sums_x_y_b_g_r[centroid_idx][4] += pixel[2];
-                    counts[centroid_idx]++;
+                    row_out[x] = colors[row_labels[x]];
                 }
             }
+        }
+    }
+
+    // Grid step S of k_segments superpixels
+    static float SLICGridStep(const cv::Size &size, int k_segments)
+    {
+        return std::sqrt(static_cast<float>(size.width) * size.height / k_segments);
+    }
+
+    static void SLICSegment(const cv::Mat &img, int k_segments, float m_balance, int max_iterations, int flags, const cv::Mat (&planes)[3], SLICCentroids &centroids,
+                            cv::Mat &labels, cv::Mat &distances, SLICSums *stats = nullptr, SLICCentroids *starting_centroids = nullptr, const std::function<void()> &on_iteration = nullptr);
+
+    // SLIC_PYRAMID: segments a 2x downscaled copy of the image (recursively, while the grid step of the next level stays at least
+    // SLIC_PYRAMID_MIN_GRID_STEP) and starts this level from its upsampled labels instead of a grid.
+    // Returns false when the image is too small for another level.
+    static bool SLICSeedFromPyramid(const cv::Mat &img, int k_segments, float m_balance, int max_iterations, int flags, const cv::Mat (&planes)[3], SLICCentroids &centroids,
+                                    cv::Mat &labels, cv::Mat &distances)
+    {
+        const float S = SLICGridStep(img.size(), k_segments);
+        if (S / 2 < SLIC_PYRAMID_MIN_GRID_STEP)
+        {
+            return false;
+        }
+
+        cv::Mat img_small;
+        cv::resize(img, img_small, cv::Size((img.size[1] + 1) / 2, (img.size[0] + 1) / 2), 0, 0, cv::INTER_AREA);
+
+        cv::Mat planes_small[3];
+        SLICSplit(img_small, planes_small, flags & SLIC_LAB);
+        cv::Mat labels_small(img_small.size(), CV_32SC1, cv::Scalar(-1));
+        cv::Mat distances_small(img_small.size(), CV_32FC1);
+
+        SLICSegment(img_small, k_segments, m_balance, max_iterations, flags, planes_small, centroids, labels_small, distances_small);
+
+        // Centroids that own no pixel after the upsample are not moved by the update below, scale all of them to this level first
+        const float scale_x = static_cast<float>(img.size[1]) / img_small.size[1];
+        const float scale_y = static_cast<float>(img.size[0]) / img_small.size[0];
+        for (int i = 0; i < centroids.Size(); ++i)
+        {
+            centroids.x[i] *= scale_x;
+            centroids.y[i] *= scale_y;
+        }
+
+        // Positions and colors of the centroids at this level from the upsampled labels
+        cv::resize(labels_small, labels, img.size(), 0, 0, cv::INTER_NEAREST);
+        const float spatial_weight = (m_balance / S) * (m_balance / S);
+        SLICIterate(planes, centroids, S, spatial_weight, labels, distances, flags & SLIC_PARALLEL, false);
+
+        return true;
+    }
+
+    // Seeds the centroids and runs up to max_iterations assign + update iterations.
+    // planes hold the colors of img, labels (initialized to -1) and distances have the size of img.
+    // stats -> sums of the last update step, starting_centroids -> the seeds, on_iteration -> called after every iteration
+    static void SLICSegment(const cv::Mat &img, int k_segments, float m_balance, int max_iterations, int flags, const cv::Mat (&planes)[3], SLICCentroids &centroids,
+                            cv::Mat &labels, cv::Mat &distances, SLICSums *stats, SLICCentroids *starting_centroids, const std::function<void()> &on_iteration)
+    {
+        auto S = SLICGridStep(img.size(), k_segments);
+
+        // SLIC: S is not an integer multiple of the image size
+        // assert(S == x_count * y_count);
+
+        // Weight of the squared spatial distance: D = sqrt(dc^2 + (m / S)^2 * ds^2)
+        const float spatial_weight = (m_balance / S) * (m_balance / S);
+
+        int iterations = max_iterations;
+        centroids.Clear();
+        if ((flags & SLIC_PYRAMID) && SLICSeedFromPyramid(img, k_segments, m_balance, max_iterations, flags, planes, centroids, labels, distances))
+        {
+            // The coarse levels did the long moves, only refine here
+            iterations = std::min(max_iterations, SLIC_PYRAMID_REFINE_ITERATIONS);
+        }
+        else
+        {
+            SLICSeedCentroids(img, planes, S, centroids, flags & SLIC_PARALLEL);
+        }
 
-            // Divide all sums by their pixel counts
-            for (int i = 0; i < centroids.size(); ++i)
+        if (starting_centroids != nullptr)
+        {
+            *starting_centroids = centroids;
+        }
+
+        bool centroids_moved = true;
+        for (int i = 0; centroids_moved && i < iterations; i++)
+        {
+            centroids_moved = SLICIterate(planes, centroids, S, spatial_weight, labels, distances, flags & SLIC_PARALLEL, true, stats);
+
+            if (on_iteration)
             {
-                auto &centroid_x = centroids[i].first[0];
-                auto &centroid_y = centroids[i].first[1];
-                auto &centroid_color = centroids[i].second;
+                on_iteration();
+            }
+        }
+    }
 
-                if (counts[i] != 0)
-                {
-                    assert(counts[i]);
+    // SLIC: Simple Linear Iterative Clustering
+    cv::Mat SLIC(const cv::Mat &img, int k_segments, float m_balance, int max_iterations, bool debug_view, int flags)
+    {
+        // Color planes of the input image (BGR or Lab), converted once and reused by all iterations
+        const bool lab = flags & SLIC_LAB;
+        cv::Mat planes[3];
+        SLICSplit(img, planes, lab);
 
-                    auto new_centroid_x = static_cast<float>(sums_x_y_b_g_r[i][0]) / counts[i];
-                    auto new_centroid_y = static_cast<float>(sums_x_y_b_g_r[i][1]) / counts[i];
-                    auto new_centroid_b = static_cast<float>(sums_x_y_b_g_r[i][2]) / counts[i];
-                    auto new_centroid_g = static_cast<float>(sums_x_y_b_g_r[i][3]) / counts[i];
-                    auto new_centroid_r = static_cast<float>(sums_x_y_b_g_r[i][4]) / counts[i];
+        // Closest centroid (-1 = none yet) and squared distance to it
+        cv::Mat labels(img.size(), CV_32SC1, cv::Scalar(-1));
+        cv::Mat distances(img.size(), CV_32FC1);
 
-                    assert(new_centroid_x >= 0 && new_centroid_x < w && new_centroid_y >= 0 && new_centroid_y < h);
-                    assert(new_centroid_b >= 0 && new_centroid_b <= 255 && new_centroid_g >= 0 && new_centroid_g <= 255 && new_centroid_r >= 0 && new_centroid_r <= 255);
+        SLICCentroids centroids;
+        SLICCentroids starting_centroids;
 
-                    // Check if the centroid has moved more than a threshold
-                    if (std::abs(new_centroid_x - centroid_x) > SLIC_CENTEROIDS_MOVED_THRESHOLD ||
-                        std::abs(new_centroid_y - centroid_y) > SLIC_CENTEROIDS_MOVED_THRESHOLD)
-                    {
-                        centroids_moved = true;
-                    }
+        auto debug = [&]()
+        {
+            cv::Mat img_slic_debug = img.clone();
+            cv::Mat img_slic_debug_idx(img.size(), CV_8UC1, cv::Scalar(0));
 
-                    // Update the centroid centers
-                    centroid_x = new_centroid_x;
-                    centroid_y = new_centroid_y;
-                    centroid_color = cv::Vec3b{static_cast<unsigned char>(new_centroid_b), static_cast<unsigned char>(new_centroid_g), static_cast<unsigned char>(new_centroid_r)};
+            // Draw centroid colors to their pixels and indices to their pixels
+            SLICPaint(SLICCentroidColors(centroids, lab), labels, img_slic_debug);
+            for (int y = 0; y < img_slic_debug_idx.size[0]; ++y)
+            {
+                for (int x = 0; x < img_slic_debug_idx.size[1]; x++)
+                {
+                    img_slic_debug_idx.at<unsigned char>(y, x) = (labels.at<int>(y, x) * 5 + 125) % 255;
                 }
             }
 
-            if (debug_view)
+            // Draw centroids
+            for (int i = 0; i < centroids.Size(); ++i)
             {
-                cv::Mat img_slic_debug = img.clone();
-                cv::Mat img_slic_debug_idx(img.size(), CV_8UC1);
+                cv::circle(img_slic_debug, cv::Point(centroids.x[i], centroids.y[i]), 2, SLIC_CENTROID_COLOR, cv::FILLED);
+                cv::circle(img_slic_debug_idx, cv::Point(centroids.x[i], centroids.y[i]), 2, SLIC_CENTROID_COLOR, cv::FILLED);
 
-                // Draw centroid colors to their pixels and indices to their pixels
-                for (int y = 0; y < img_slic_debug.size[0]; ++y)
-                {
-                    for (int x = 0; x < img_slic_debug.size[1]; x++)
-                    {
-                        img_slic_debug.at<cv::Vec3b>(y, x) = centroids[static_cast<int>(img_slic_indices.at<cv::Vec2f>(y, x)[1])].second;
-                        img_slic_debug_idx.at<unsigned char>(y, x) = (static_cast<int>(img_slic_indices.at<cv::Vec2f>(y, x)[1]) * 5 + 125) % 255;
-                    }
-                }
+                cv::circle(img_slic_debug, cv::Point(starting_centroids.x[i], starting_centroids.y[i]), 2, SLIC_CENTROID_STARTING_COLOR, cv::FILLED);
+                cv::circle(img_slic_debug_idx, cv::Point(starting_centroids.x[i], starting_centroids.y[i]), 2, SLIC_CENTROID_STARTING_COLOR, cv::FILLED);
+            }
 
-                // Draw centroids
-                for (int i = 0; i < centroids.size(); ++i)
-                {
-                    const auto &centroid_x = centroids[i].first[0];
-                    const auto &centroid_y = centroids[i].first[1];
+            cv::namedWindow("SLIC debug", cv::WINDOW_AUTOSIZE);
+            cv::imshow("SLIC debug", img_slic_debug);
+
+            cv::namedWindow("SLIC debug indices", cv::WINDOW_AUTOSIZE);
+            cv::imshow("SLIC debug indices", img_slic_debug_idx);
+
+            cv::waitKey(0);
+        };
+
+        SLICSegment(img, k_segments, m_balance, max_iterations, flags, planes, centroids, labels, distances, nullptr, &starting_centroids, debug_view ? debug : std::function<void()>());
+
+        // Step 3: Redraw pixels by centroid color & Draw centroids:
+        cv::Mat img_slic = img.clone();
+        SLICPaint(SLICCentroidColors(centroids, lab), labels, img_slic);
+
+        for (int i = 0; i < centroids.Size(); ++i)
+        {
+            cv::circle(img_slic, cv::Point(centroids.x[i], centroids.y[i]), 2, SLIC_CENTROID_COLOR, cv::FILLED);
+            cv::circle(img_slic, cv::Point(starting_centroids.x[i], starting_centroids.y[i]), 2, SLIC_CENTROID_STARTING_COLOR, cv::FILLED);
+        }
 
-                    cv::circle(img_slic_debug, cv::Point(centroid_x, centroid_y), 2, SLIC_CENTROID_COLOR, cv::FILLED);
-                    cv::circle(img_slic_debug_idx, cv::Point(centroid_x, centroid_y), 2, SLIC_CENTROID_COLOR, cv::FILLED);
+        return img_slic;
+    }
 
-                    const auto &starting_centroid_x = starting_centroids[i].first[0];
-                    const auto &starting_centroid_y = starting_centroids[i].first[1];
+    // Assigns pixels still labeled -1 (no centroid's 2S window reached them) to the nearest centroid by the full SLIC
+    // distance and adds them to sums (with bounds) when given. Such pixels are rare, so all centroids are searched.
+    static void SLICAssignUnlabeled(const cv::Mat (&planes)[3], const SLICCentroids &centroids, float spatial_weight, cv::Mat &labels, SLICSums *sums)
+    {
+        if (centroids.Size() == 0)
+        {
+            return;
+        }
 
-                    cv::circle(img_slic_debug, cv::Point(starting_centroid_x, starting_centroid_y), 2, SLIC_CENTROID_STARTING_COLOR, cv::FILLED);
-                    cv::circle(img_slic_debug_idx, cv::Point(starting_centroid_x, starting_centroid_y), 2, SLIC_CENTROID_STARTING_COLOR, cv::FILLED);
+        for (int y = 0; y < labels.size[0]; ++y)
+        {
+            int *row_labels = labels.ptr<int>(y);
+            const float *row0 = planes[0].ptr<float>(y);
+            const float *row1 = planes[1].ptr<float>(y);
+            const float *row2 = planes[2].ptr<float>(y);
+
+            for (int x = 0; x < labels.size[1]; ++x)
+            {
+                if (row_labels[x] >= 0)
+                {
+                    continue;
                 }
 
-                cv::namedWindow("SLIC debug", cv::WINDOW_AUTOSIZE);
-                cv::imshow("SLIC debug", img_slic_debug);
+                int nearest = 0;
+                float nearest_distance = std::numeric_limits<float>::max();
+                for (int i = 0; i < centroids.Size(); ++i)
+                {
+                    const float d0 = row0[x] - centroids.c0[i];
+                    const float d1 = row1[x] - centroids.c1[i];
+                    const float d2 = row2[x] - centroids.c2[i];
+                    const float dx = x - centroids.x[i];
+                    const float dy = y - centroids.y[i];
+
+                    const float distance = d0 * d0 + d1 * d1 + d2 * d2 + spatial_weight * (dx * dx + dy * dy);
+                    if (distance < nearest_distance)
+                    {
+                        nearest_distance = distance;
+                        nearest = i;
+                    }
+                }
 
-                cv::namedWindow("SLIC debug indices", cv::WINDOW_AUTOSIZE);
-                cv::imshow("SLIC debug indices", img_slic_debug_idx);
+                row_labels[x] = nearest;
+                if (sums == nullptr)
+                {
+                    continue;
+                }
 
-                cv::waitKey(0);
+                auto &bounds = sums->bounds[nearest];
+                bounds[0] = std::min(bounds[0], x);
+                bounds[1] = std::min(bounds[1], y);
+                bounds[2] = std::max(bounds[2], x);
+                bounds[3] = std::max(bounds[3], y);
+
+                sums->x[nearest] += x;
+                sums->y[nearest] += y;
+                sums->c0[nearest] += row0[x];
+                sums->c1[nearest] += row1[x];
+                sums->c2[nearest] += row2[x];
+                sums->counts[nearest]++;
             }
+        }
+    }
 
-            // Increment iteration counter
-            iterations++;
+    void SLICLabels(const cv::Mat &img, cv::Mat &labels, SLICSuperpixels &superpixels, int k_segments, float m_balance, int max_iterations, int flags)
+    {
+        cv::Mat planes[3];
+        SLICSplit(img, planes, flags & SLIC_LAB);
+
+        labels.create(img.size(), CV_32SC1);
+        labels.setTo(-1);
+        cv::Mat distances(img.size(), CV_32FC1);
+
+        // Statistics are taken from the sums of the last update step, no extra pass over the image
+        SLICCentroids centroids;
+        SLICSums sums;
+        SLICSegment(img, k_segments, m_balance, max_iterations, flags, planes, centroids, labels, distances, &sums);
+
+        // Every pixel gets a superpixel, the statistics include the pixels assigned here
+        const float S = SLICGridStep(img.size(), k_segments);
+        const float spatial_weight = (m_balance / S) * (m_balance / S);
+        const bool have_sums = !sums.counts.empty();
+        SLICAssignUnlabeled(planes, centroids, spatial_weight, labels, have_sums ? &sums : nullptr);
+        if (!have_sums)
+        {
+            // No update step ran (max_iterations <= 0)
+            sums.Reset(centroids.Size(), true);
+            SLICAccumulate<true>(planes, labels, sums, 0, labels.size[0]);
         }
 
-        // Step 3: Redraw pixels by centroid color & Draw centroids:
-        for (int y = 0; y < img_slic.size[0]; ++y)
+        superpixels.assign(centroids.Size(), SLICSuperpixel());
+
+        for (int i = 0; i < centroids.Size(); i++)
         {
-            for (int x = 0; x < img_slic.size[1]; x++)
+            const int count = sums.counts[i];
+            if (count == 0)
             {
-                img_slic.at<cv::Vec3b>(y, x) = centroids[static_cast<int>(img_slic_indices.at<cv::Vec2f>(y, x)[1])].second;
+                continue;
             }
+
+            auto &superpixel = superpixels[i];
+            superpixel.count = count;
+            superpixel.mean_color = cv::Vec3f(sums.c0[i] / count, sums.c1[i] / count, sums.c2[i] / count);
+            superpixel.centroid = cv::Point2f(sums.x[i] / count, sums.y[i] / count);
+
+            const auto &bounds = sums.bounds[i];
+            superpixel.bounding_box = cv::Rect(bounds[0], bounds[1], bounds[2] - bounds[0] + 1, bounds[3] - bounds[1] + 1);
         }
+    }
 
-        // Draw centroids
-        for (int i = 0; i < centroids.size(); ++i)
-        {
-            const auto &centroid_x = centroids[i].first[0];
-            const auto &centroid_y = centroids[i].first[1];
+    TemporalSLIC::TemporalSLIC(int k_segments, float m_balance, int flags, int refine_iterations, int max_iterations)
+        : k_segments(k_segments), m_balance(m_balance), flags(flags), refine_iterations(refine_iterations), max_iterations(max_iterations)
+    {
+    }
 
-            cv::circle(img_slic, cv::Point(centroid_x, centroid_y), 2, SLIC_CENTROID_COLOR, cv::FILLED);
+    const cv::Mat &TemporalSLIC::Process(const cv::Mat &frame)
+    {
+        const bool lab = flags & SLIC_LAB;
+        const bool parallel = flags & SLIC_PARALLEL;
 
-            const auto &starting_centroid_x = starting_centroids[i].first[0];
-            const auto &starting_centroid_y = starting_centroids[i].first[1];
+        const float S = SLICGridStep(frame.size(), k_segments);
+        const float spatial_weight = (m_balance / S) * (m_balance / S);
 
-            cv::circle(img_slic, cv::Point(starting_centroid_x, starting_centroid_y), 2, SLIC_CENTROID_STARTING_COLOR, cv::FILLED);
+        SLICSplit(frame, planes, lab);
+
+        if (!initialized || labels.size() != frame.size())
+        {
+            // Start from a grid (or a pyramid)
+            labels.create(frame.size(), CV_32SC1);
+            labels.setTo(-1);
+            distances.create(frame.size(), CV_32FC1);
+            SLICSegment(frame, k_segments, m_balance, max_iterations, flags, planes, centroids, labels, distances);
+            SLICAssignUnlabeled(planes, centroids, spatial_weight, labels, nullptr);
+
+            initialized = true;
+            return labels;
         }
 
-        return img_slic;
+        // Start from the previous segmentation: centroids take the colors of their pixels in the new frame
+        SLICIterate(planes, centroids, S, spatial_weight, labels, distances, parallel, false);
+
+        bool centroids_moved = true;
+        for (int i = 0; centroids_moved && i < refine_iterations; i++)
+        {
+            centroids_moved = SLICIterate(planes, centroids, S, spatial_weight, labels, distances, parallel);
+        }
+
+        return labels;
+    }
+
+    void TemporalSLIC::Reset()
+    {
+        initialized = false;
+    }
+
+    void TemporalSLIC::Paint(cv::Mat &img_out) const
+    {
+        img_out.create(labels.size(), CV_8UC3);
+        img_out.setTo(cv::Scalar(0, 0, 0));
+        SLICPaint(SLICCentroidColors(centroids, flags & SLIC_LAB), labels, img_out);
     }
-}
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "threshold.hpp"
+#include "simd.hpp"
+
+#include <cstring>
+
+namespace ano
+{
+#if defined(ANO_ENABLE_AVX2)
+    // ThresholdRangeRow for 32 pixels at once, returns the number of pixels processed
+    ANO_AVX2_TARGET static int ThresholdRangeRowAVX2(const unsigned char *src, unsigned char *dst, int count, unsigned char low, unsigned char high)
+    {
+        const __m256i v_low = _mm256_set1_epi8(static_cast<char>(low));
+        const __m256i v_high = _mm256_set1_epi8(static_cast<char>(high));
+
+        // v is in range when max(v, low) == v and min(v, high) == v (unsigned compares)
+        int x = 0;
+        for (; x <= count - 32; x += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+            __m256i above_low = _mm256_cmpeq_epi8(_mm256_max_epu8(v, v_low), v);
+            __m256i below_high = _mm256_cmpeq_epi8(_mm256_min_epu8(v, v_high), v);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), _mm256_and_si256(above_low, below_high));
+        }
+        return x;
+    }
+#endif
+
+    // Sets dst[x] to 255 where low <= src[x] <= high, 0 elsewhere
+    static void ThresholdRangeRow(const unsigned char *src, unsigned char *dst, int count, unsigned char low, unsigned char high)
+    {
+        int x = 0;
+
+#if defined(ANO_ENABLE_AVX2)
+        if (HasAVX2())
+        {
+            x = ThresholdRangeRowAVX2(src, dst, count, low, high);
+        }
+#endif
+
+        // Remaining pixels (or all of them without AVX2)
+        for (; x < count; x++)
+        {
+            dst[x] = (src[x] >= low && src[x] <= high) ? 255 : 0;
+        }
+    }
+
+    void ThresholdRange(const cv::Mat &img, cv::Mat &img_threshold, unsigned char low, unsigned char high)
+    {
+        assert(img.type() == CV_8UC1);
+
+        img_threshold.create(img.size(), CV_8UC1);
+
+        auto ymax = img.size[0];
+        auto xmax = img.size[1];
+
+        // Both continuous -> process the whole image as one row
+        if (img.isContinuous() && img_threshold.isContinuous())
+        {
+            xmax *= ymax;
+            ymax = 1;
+        }
+
+        for (int y = 0; y < ymax; y++)
+        {
+            if (low > high)
+            {
+                std::memset(img_threshold.ptr<unsigned char>(y), 0, xmax);
+                continue;
+            }
+
+            ThresholdRangeRow(img.ptr<unsigned char>(y), img_threshold.ptr<unsigned char>(y), xmax, low, high);
+        }
+    }
+
+    void Threshold(const cv::Mat &img, cv::Mat &img_threshold, unsigned char threshold)
+    {
+        // img > threshold == [threshold + 1, 255], empty for 255
+        if (threshold == 255)
+        {
+            ThresholdRange(img, img_threshold, 1, 0);
+            return;
+        }
+
+        ThresholdRange(img, img_threshold, threshold + 1, 255);
+    }
+
+    void ThresholdInverse(const cv::Mat &img, cv::Mat &img_threshold, unsigned char threshold)
+    {
+        ThresholdRange(img, img_threshold, 0, threshold);
+    }
+
+    unsigned char OtsuThreshold(const cv::Mat &img)
+    {
+        assert(img.type() == CV_8UC1);
+
+        int histogram[256] = {};
+        for (int y = 0; y < img.size[0]; y++)
+        {
+            const unsigned char *row = img.ptr<unsigned char>(y);
+            for (int x = 0; x < img.size[1]; x++)
+            {
+                histogram[row[x]]++;
+            }
+        }
+
+        double total = static_cast<double>(img.total());
+        double sum_all = 0.0;
+        for (int i = 0; i < 256; i++)
+        {
+            sum_all += static_cast<double>(i) * histogram[i];
+        }
+
+        // Maximize between-class variance w_b * w_f * (mean_b - mean_f)^2 over all thresholds (background = values <= t)
+        double weight_background = 0.0, sum_background = 0.0;
+        double best_variance = -1.0;
+        unsigned char best_threshold = 0;
+        for (int t = 0; t < 256; t++)
+        {
+            weight_background += histogram[t];
+            sum_background += static_cast<double>(t) * histogram[t];
+
+            double weight_foreground = total - weight_background;
+            if (weight_background == 0.0 || weight_foreground == 0.0)
+            {
+                continue;
+            }
+
+            double mean_background = sum_background / weight_background;
+            double mean_foreground = (sum_all - sum_background) / weight_foreground;
+            double variance = weight_background * weight_foreground * (mean_background - mean_foreground) * (mean_background - mean_foreground);
+
+            if (variance > best_variance)
+            {
+                best_variance = variance;
+                best_threshold = static_cast<unsigned char>(t);
+            }
+        }
+
+        return best_threshold;
+    }
+
+    unsigned char ThresholdOtsu(const cv::Mat &img, cv::Mat &img_threshold)
+    {
+        auto threshold = OtsuThreshold(img);
+        Threshold(img, img_threshold, threshold);
+        return threshold;
+    }
+}
\ No newline at end of file